@@ -4,6 +4,7 @@
 #include <cctype>
 #include <cmath>
 #include <limits>
+#include <utility>
 
 Atom::Atom(): m_type(NoneKind) {}
 
@@ -94,6 +95,38 @@ Atom & Atom::operator=(const Atom & x){
   }
   return *this;
 }
+
+Atom::Atom(Atom && x) noexcept: Atom(){
+  *this = std::move(x);
+}
+
+Atom & Atom::operator=(Atom && x) noexcept{
+
+  if(this != &x){
+    bool hasString = (m_type == SymbolKind || m_type == ListKind || m_type == LambdaKind);
+    if(x.m_type == SymbolKind || x.m_type == ListKind || x.m_type == LambdaKind){
+      if(hasString){
+        stringValue = std::move(x.stringValue);
+      }
+      else{
+        new (&stringValue) std::string(std::move(x.stringValue));
+      }
+    }
+    else{
+      if(hasString){
+        stringValue.~basic_string();
+      }
+      if(x.m_type == NumberKind){
+        numberValue = x.numberValue;
+      }
+      else if(x.m_type == ComplexNumberKind){
+        complexNumberValue = x.complexNumberValue;
+      }
+    }
+    m_type = x.m_type;
+  }
+  return *this;
+}
   
 Atom::~Atom(){
   // we need to ensure the destructor of the symbol string is called
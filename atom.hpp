@@ -36,6 +36,12 @@ public:
   /// Assign an Atom
   Atom & operator=(const Atom & x);
 
+  /// Move-construct an Atom, leaving x valid but unspecified
+  Atom(Atom && x) noexcept;
+
+  /// Move-assign an Atom, leaving x valid but unspecified
+  Atom & operator=(Atom && x) noexcept;
+
   /// Atom destructor
   ~Atom();
 
@@ -0,0 +1,107 @@
+/*! \file cancel_token.hpp
+Defines the cancellation token, and the limits and shared budget that stop a
+running evaluation.
+ */
+#ifndef CANCEL_TOKEN_HPP
+#define CANCEL_TOKEN_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+/*! \class CancelToken
+\brief A flag another thread or a signal handler raises to stop an evaluation.
+
+The evaluator polls the token once per expression node, which is a single
+relaxed atomic load. Raising it is lock-free, so cancel may be called from a
+signal handler.
+
+A token may also watch up to two others, it then reads as raised while it or
+either of them is. The watched tokens are kept alive by the watching one.
+ */
+class CancelToken {
+public:
+
+  CancelToken() noexcept : m_flag(false) {}
+
+  /// a token that is also raised while first or second is, either may be empty
+  CancelToken(std::shared_ptr<const CancelToken> first, std::shared_ptr<const CancelToken> second) noexcept
+    : m_flag(false), m_first(std::move(first)), m_second(std::move(second)) {}
+
+  CancelToken(const CancelToken &) = delete;
+  CancelToken & operator=(const CancelToken &) = delete;
+
+  /// request that the evaluation polling this token stops
+  void cancel() noexcept { m_flag.store(true, std::memory_order_relaxed); }
+
+  /// clear a request, e.g. before starting the next evaluation
+  void reset() noexcept { m_flag.store(false, std::memory_order_relaxed); }
+
+  /// true if cancel was called since the last reset, or a watched token is raised
+  bool cancelled() const noexcept {
+    return m_flag.load(std::memory_order_relaxed) ||
+      (m_first && m_first->cancelled()) || (m_second && m_second->cancelled());
+  }
+
+private:
+  std::atomic<bool> m_flag;
+
+  // the tokens this one watches, fixed at construction
+  const std::shared_ptr<const CancelToken> m_first;
+  const std::shared_ptr<const CancelToken> m_second;
+};
+
+/*! \struct EvalLimits
+\brief Optional bounds on a single evaluation, zero means unbounded.
+ */
+struct EvalLimits {
+
+  /// the most expression nodes the evaluation may enter
+  std::size_t maxSteps = 0;
+
+  /// the most wall-clock time the evaluation may take
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(0);
+
+  /// true if either bound is set
+  bool bounded() const noexcept { return maxSteps != 0 || timeout.count() > 0; }
+};
+
+/*! \class EvalBudget
+\brief The steps and time left to an evaluation, shared by every thread it runs on.
+
+The evaluation and the tasks it starts on the pool (parallel-map, future,
+continuous-plot sampling) count their steps against one atomic counter and
+stop at one deadline, so work spread across threads cannot exceed the limits
+the caller set. Counting is a relaxed fetch_add, only done if there is a step
+bound.
+ */
+class EvalBudget {
+public:
+
+  /// start the clock on limits now
+  explicit EvalBudget(const EvalLimits & limits) noexcept
+    : m_steps(0), m_maxSteps(limits.maxSteps), m_timed(limits.timeout.count() > 0),
+      m_deadline(std::chrono::steady_clock::now() + limits.timeout) {}
+
+  EvalBudget(const EvalBudget &) = delete;
+  EvalBudget & operator=(const EvalBudget &) = delete;
+
+  /// count one step, false once more steps were taken than the bound allows
+  bool step() noexcept {
+    return m_maxSteps == 0 || m_steps.fetch_add(1, std::memory_order_relaxed) < m_maxSteps;
+  }
+
+  /// true if there is a deadline and it has passed, reads the clock
+  bool expired() const noexcept {
+    return m_timed && std::chrono::steady_clock::now() > m_deadline;
+  }
+
+private:
+  std::atomic<std::size_t> m_steps;
+  const std::size_t m_maxSteps;
+  const bool m_timed;
+  const std::chrono::steady_clock::time_point m_deadline;
+};
+
+#endif
@@ -1,10 +1,16 @@
 #include "environment.hpp"
 #include <iostream>// for debugging
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <complex>
+#include <utility>
 
 #include "environment.hpp"
+#include "future.hpp"
+#include "graphics.hpp"
+#include "memo.hpp"
+#include "reduce.hpp"
 #include "semantic_error.hpp"
 
 /*********************************************************************** 
@@ -12,7 +18,7 @@ Helper Functions
 **********************************************************************/
 
 // predicate, the number of args is nargs
-bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
+bool nargs_equal(Arguments args, unsigned nargs){
   return args.size() == nargs;
 }
 
@@ -22,71 +28,341 @@ typedef'd Procedure function pointer.
 **********************************************************************/
 
 // the default procedure always returns an expresison of type None
-Expression default_proc(const std::vector<Expression> & args){
+Expression default_proc(Arguments args){
   args.size(); // make compiler happy we used this parameter
   return Expression();
 };
 
-Expression add(const std::vector<Expression> & args){
-  double result = 0;
-  std::complex<double> complexResult(0., 0.);
-  bool usingComplex = false;
+// the running sums of add, kept apart until the end like the sequential loop
+struct Sum {
+  double real;
+  std::complex<double> complex;
+  bool usingComplex;
+};
+
+Sum sumChunk(Arguments args){
+  Sum sum = {0, std::complex<double>(0., 0.), false};
 
   // check all aruments are numbers, while adding
   for( auto & a :args){
     if(a.isHeadNumber()){
-      result += a.head().asNumber();      
+      sum.real += a.head().asNumber();      
     }
     else if (a.isHeadComplexNumber()) {
-      complexResult += a.head().asComplexNumber();
-      usingComplex = true;
+      sum.complex += a.head().asComplexNumber();
+      sum.usingComplex = true;
     }
     else{
       throw SemanticError("Error in call to add, argument not a number");
     }
   }
+  return sum;
+}
 
-  if (!usingComplex) {
-    return Expression(result);
+Sum sumCombine(const Sum & left, const Sum & right){
+  return Sum{left.real + right.real, left.complex + right.complex, left.usingComplex || right.usingComplex};
+}
+
+Expression add(Arguments args){
+
+  Sum sum = reduce<Sum>(args, sumChunk, sumCombine);
+
+  if (!sum.usingComplex) {
+    return Expression(sum.real);
   }
   else {
-    complexResult += result;
-    return Expression(complexResult);
+    return Expression(sum.complex + sum.real);
   }
+};
 
+// Neumaier's compensated sum, the running error is carried in compensation
+struct CompensatedSum {
+  double sum[2];
+  double compensation[2];
+  bool usingComplex;
 };
 
-Expression mul(const std::vector<Expression> & args){
- 
-  double result = 1;
-  std::complex<double> complexResult(1., 0.);
-  bool usingComplex = false;
+void compensatedAdd(CompensatedSum & s, int part, double x){
+  double t = s.sum[part] + x;
+  if (std::fabs(s.sum[part]) >= std::fabs(x))
+    s.compensation[part] += (s.sum[part] - t) + x;
+  else
+    s.compensation[part] += (x - t) + s.sum[part];
+  s.sum[part] = t;
+}
+
+CompensatedSum fsumChunk(Arguments args){
+  CompensatedSum s = {{0, 0}, {0, 0}, false};
+
+  for( auto & a :args){
+    if(a.isHeadNumber()){
+      compensatedAdd(s, 0, a.head().asNumber());
+    }
+    else if (a.isHeadComplexNumber()) {
+      compensatedAdd(s, 0, a.head().asComplexNumber().real());
+      compensatedAdd(s, 1, a.head().asComplexNumber().imag());
+      s.usingComplex = true;
+    }
+    else{
+      throw SemanticError("Error in call to fsum, argument not a number");
+    }
+  }
+  return s;
+}
+
+CompensatedSum fsumCombine(const CompensatedSum & left, const CompensatedSum & right){
+  CompensatedSum s = left;
+  for (int part = 0; part < 2; ++part) {
+    compensatedAdd(s, part, right.sum[part]);
+    s.compensation[part] += right.compensation[part];
+  }
+  s.usingComplex = left.usingComplex || right.usingComplex;
+  return s;
+}
+
+Expression fsum(Arguments args){
+
+  CompensatedSum s = reduce<CompensatedSum>(args, fsumChunk, fsumCombine);
+
+  double real = s.sum[0] + s.compensation[0];
+  if (!s.usingComplex) {
+    return Expression(real);
+  }
+  else {
+    return Expression(std::complex<double>(real, s.sum[1] + s.compensation[1]));
+  }
+};
+
+// the running products of mul, kept apart until the end like the sequential loop
+struct Product {
+  double real;
+  std::complex<double> complex;
+  bool usingComplex;
+};
+
+Product productChunk(Arguments args){
+  Product product = {1, std::complex<double>(1., 0.), false};
 
   // check all aruments are numbers, while multiplying
   for( auto & a :args){
     if(a.isHeadNumber()){
-      result *= a.head().asNumber();      
+      product.real *= a.head().asNumber();      
     }
     else if(a.isHeadComplexNumber()){
-      usingComplex = true;
-      complexResult *= a.head().asComplexNumber();
+      product.usingComplex = true;
+      product.complex *= a.head().asComplexNumber();
     }
     else{
       throw SemanticError("Error in call to mul, argument not a number");
     }
   }
+  return product;
+}
 
-  if (!usingComplex) {
-    return Expression(result);
+Product productCombine(const Product & left, const Product & right){
+  return Product{left.real * right.real, left.complex * right.complex, left.usingComplex || right.usingComplex};
+}
+
+Expression mul(Arguments args){
+
+  Product product = reduce<Product>(args, productChunk, productCombine);
+
+  if (!product.usingComplex) {
+    return Expression(product.real);
   }
   else {
-    complexResult *= result;
-    return Expression(complexResult);
+    return Expression(product.complex * product.real);
   }
-
 };
 
-Expression power(const std::vector<Expression> & args) {
+// the least or greatest of one chunk of Numbers, Complex numbers have no order
+template<bool greatest>
+double extremeChunk(Arguments args){
+  double result = args[0].isHeadNumber() ? args[0].head().asNumber() : 0;
+  for( auto & a :args){
+    if(!a.isHeadNumber()){
+      throw SemanticError(greatest ? "Error in call to max, argument not a real number"
+                                   : "Error in call to min, argument not a real number");
+    }
+    double x = a.head().asNumber();
+    if(greatest ? (x > result) : (x < result)){
+      result = x;
+    }
+  }
+  return result;
+}
+
+template<bool greatest>
+double extremeCombine(const double & left, const double & right){
+  return (greatest ? (right > left) : (right < left)) ? right : left;
+}
+
+Expression min(Arguments args){
+  if (args.empty()) {
+    throw SemanticError("Error in call to min: invalid number of arguments.");
+  }
+  return Expression(reduce<double>(args, extremeChunk<false>, extremeCombine<false>));
+}
+
+Expression max(Arguments args){
+  if (args.empty()) {
+    throw SemanticError("Error in call to max: invalid number of arguments.");
+  }
+  return Expression(reduce<double>(args, extremeChunk<true>, extremeCombine<true>));
+}
+
+// the least and greatest of one chunk of histogram data
+std::pair<double, double> extentChunk(Arguments args){
+  std::pair<double, double> extent(args[0].isHeadNumber() ? args[0].head().asNumber() : 0, 0);
+  extent.second = extent.first;
+  for( auto & a :args){
+    if(!a.isHeadNumber()){
+      throw SemanticError("Error in call to histogram: data not a list of real numbers.");
+    }
+    extent.first = std::min(extent.first, a.head().asNumber());
+    extent.second = std::max(extent.second, a.head().asNumber());
+  }
+  return extent;
+}
+
+std::pair<double, double> extentCombine(const std::pair<double, double> & left, const std::pair<double, double> & right){
+  return std::make_pair(std::min(left.first, right.first), std::max(left.second, right.second));
+}
+
+// the bin of x among ascending edges, the last bin includes its right edge,
+// or -1 if x is outside them
+long binOf(const std::vector<double> & edges, bool uniform, double x){
+  const std::size_t bins = edges.size() - 1;
+  if(!(x >= edges.front() && x <= edges.back())){
+    return -1;
+  }
+  std::size_t bin;
+  if(uniform){
+    bin = static_cast<std::size_t>((x - edges.front()) / (edges.back() - edges.front()) * bins);
+    // rounding may land a value next to an edge one bin off
+    if(bin > 0 && x < edges[bin]) --bin;
+    if(bin < bins && x >= edges[bin + 1]) ++bin;
+  }
+  else{
+    bin = std::upper_bound(edges.begin(), edges.end(), x) - edges.begin() - 1;
+  }
+  return static_cast<long>(std::min(bin, bins - 1));
+}
+
+// the most bins a histogram may have, each worker counts into its own copy
+const double maxBins = 1000000;
+
+// count the data into bins: a list of numbers, then optionally a list of
+// options (list "bins" n), (list "edges" (list e0 e1 ...)) and (list "density" 1)
+Expression histogram(Arguments args){
+
+  if (!nargs_equal(args, 1) && !nargs_equal(args, 2)) {
+    throw SemanticError("Error in call to histogram: invalid number of arguments.");
+  }
+  if (!args[0].isHeadList()) {
+    throw SemanticError("Error in call to histogram: data not a list of real numbers.");
+  }
+  if (args.size() == 2 && !args[1].isHeadList()) {
+    throw SemanticError("Error in call to histogram: bad OPTIONS parameter.");
+  }
+
+  double bins = 10;
+  bool density = false;
+  std::vector<double> edges;
+  if (args.size() == 2) {
+    for (auto o = args[1].tailConstBegin(); o != args[1].tailConstEnd(); ++o) {
+      if (o->tailConstEnd() - o->tailConstBegin() != 2) {
+        throw SemanticError("Error in call to histogram: bad OPTIONS parameter.");
+      }
+      const std::string key = o->tailConstBegin()->head().asSymbol();
+      const Expression & value = *(o->tailConstBegin() + 1);
+      if (key == "\"bins\"") {
+        bins = value.isHeadNumber() ? value.head().asNumber() : 0;
+        if (bins < 1 || bins != std::floor(bins)) {
+          throw SemanticError("Error in call to histogram: bins not a positive integer.");
+        }
+        if (bins > maxBins) {
+          throw SemanticError("Error in call to histogram: more than 1000000 bins.");
+        }
+      }
+      else if (key == "\"edges\"") {
+        edges.clear();
+        for (auto e = value.tailConstBegin(); e != value.tailConstEnd(); ++e) {
+          if (!e->isHeadNumber() || (!edges.empty() && !(e->head().asNumber() > edges.back()))) {
+            throw SemanticError("Error in call to histogram: edges not an increasing list of numbers.");
+          }
+          edges.push_back(e->head().asNumber());
+        }
+        if (!value.isHeadList() || edges.size() < 2) {
+          throw SemanticError("Error in call to histogram: edges not an increasing list of numbers.");
+        }
+        if (edges.size() - 1 > maxBins) {
+          throw SemanticError("Error in call to histogram: more than 1000000 bins.");
+        }
+      }
+      else if (key == "\"density\"") {
+        density = value.isHeadNumber() && value.head().asNumber() != 0;
+      }
+      else {
+        throw SemanticError("Error in call to histogram: bad OPTIONS parameter.");
+      }
+    }
+  }
+
+  const Expression * first = (args[0].tailConstBegin() == args[0].tailConstEnd()) ? nullptr : &*args[0].tailConstBegin();
+  Arguments data(first, args[0].tailConstEnd() - args[0].tailConstBegin());
+
+  // without edges the bins split the extent of the data evenly
+  const bool uniform = edges.empty();
+  if (uniform) {
+    if (data.empty()) {
+      throw SemanticError("Error in call to histogram: no data to bin without edges.");
+    }
+    std::pair<double, double> extent = reduce<std::pair<double, double>>(data, extentChunk, extentCombine);
+    if (extent.first == extent.second) {
+      extent.first -= 0.5;
+      extent.second += 0.5;
+    }
+    for (std::size_t i = 0; i <= bins; ++i) {
+      edges.push_back(extent.first + (extent.second - extent.first) * i / bins);
+    }
+    edges.back() = extent.second;
+  }
+
+  typedef std::vector<double> Counts;
+  const std::size_t nbins = edges.size() - 1;
+  Counts counts = accumulate(data, Counts(nbins, 0),
+    [&edges, uniform](Counts & partial, Arguments chunk){
+      for (auto & a : chunk) {
+        if (!a.isHeadNumber()) {
+          throw SemanticError("Error in call to histogram: data not a list of real numbers.");
+        }
+        long bin = binOf(edges, uniform, a.head().asNumber());
+        if (bin >= 0) partial[bin] += 1;
+      }
+    },
+    [](Counts & into, const Counts & from){
+      for (std::size_t i = 0; i < into.size(); ++i) into[i] += from[i];
+    });
+
+  double total = 0;
+  for (double c : counts) total += c;
+
+  Expression result(Atom("list"));
+  for (std::size_t i = 0; i < nbins; ++i) {
+    double height = counts[i];
+    if (density) {
+      height = (total > 0) ? counts[i] / (total * (edges[i + 1] - edges[i])) : 0;
+    }
+    Expression bar(Atom("list"));
+    bar.append(Atom(edges[i] + (edges[i + 1] - edges[i]) / 2));
+    bar.append(Atom(height));
+    result.appendExpression(std::move(bar));
+  }
+  return result;
+}
+
+Expression power(Arguments args) {
 
   double result = 0;
   std::complex<double> complexResult(0., 0.);
@@ -126,7 +402,7 @@ Expression power(const std::vector<Expression> & args) {
 }
 
 
-Expression subneg(const std::vector<Expression> & args){
+Expression subneg(Arguments args){
 
   double result = 0;
   std::complex<double> complexResult(0., 0.);
@@ -178,7 +454,7 @@ Expression subneg(const std::vector<Expression> & args){
   }
 };
 
-Expression sqrt(const std::vector<Expression> & args){
+Expression sqrt(Arguments args){
   
   double result = 0;
   std::complex<double> complexResult(0., 0.);
@@ -212,7 +488,7 @@ Expression sqrt(const std::vector<Expression> & args){
   }
 }
 
-Expression div(const std::vector<Expression> & args){
+Expression div(Arguments args){
 
   double result = 0;  
   std::complex<double> complexResult(0., 0.);
@@ -263,7 +539,7 @@ Expression div(const std::vector<Expression> & args){
 
 };
 
-Expression ln(const std::vector<Expression> & args) {
+Expression ln(Arguments args) {
 
   double result = 0;
 
@@ -289,7 +565,7 @@ Expression ln(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression sin(const std::vector<Expression> & args) {
+Expression sin(Arguments args) {
   
   double result = 0;
 
@@ -310,7 +586,7 @@ Expression sin(const std::vector<Expression> & args) {
   return Expression(result);
 }
 // angle argument in radians.
-Expression cos(const std::vector<Expression> & args) {
+Expression cos(Arguments args) {
 
   double result = 0;
 
@@ -332,7 +608,7 @@ Expression cos(const std::vector<Expression> & args) {
 }
 
 //angle argument in radians.
-Expression tan(const std::vector<Expression> & args) {
+Expression tan(Arguments args) {
 
   double result = 0;
 
@@ -353,7 +629,7 @@ Expression tan(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression real(const std::vector<Expression> & args) {
+Expression real(Arguments args) {
   double result = 0;
 
   if (nargs_equal(args, 1))
@@ -371,7 +647,7 @@ Expression real(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression imag(const std::vector<Expression> & args) {
+Expression imag(Arguments args) {
   double result = 0;
 
   if (nargs_equal(args, 1))
@@ -389,7 +665,7 @@ Expression imag(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression mag(const std::vector<Expression> & args) {
+Expression mag(Arguments args) {
   double result = 0;
 
   if (nargs_equal(args, 1))
@@ -409,7 +685,7 @@ Expression mag(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression arg(const std::vector<Expression> & args) {
+Expression arg(Arguments args) {
   double result = 0;
 
   if (nargs_equal(args, 1))
@@ -427,7 +703,7 @@ Expression arg(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression conj(const std::vector<Expression> & args) {
+Expression conj(Arguments args) {
   std::complex<double> result;
 
   if (nargs_equal(args, 1))
@@ -445,7 +721,79 @@ Expression conj(const std::vector<Expression> & args) {
   return Expression(result);
 }
 
-Expression list(const std::vector<Expression> & args) {
+// comparisons evaluate to the Number 1 when true and 0 when false
+Expression compare(Arguments args, const std::string & name, bool (*pred)(double, double)) {
+
+  if (!nargs_equal(args, 2)) {
+    throw SemanticError("Error in call to " + name + ": invalid number of arguments.");
+  }
+  if (!args[0].isHeadNumber() || !args[1].isHeadNumber()) {
+    throw SemanticError("Error in call to " + name + ": invalid argument.");
+  }
+  return Expression(pred(args[0].head().asNumber(), args[1].head().asNumber()) ? 1. : 0.);
+}
+
+bool less_than(double a, double b) { return a < b; }
+bool greater_than(double a, double b) { return a > b; }
+bool equal_to(double a, double b) { return a == b; }
+
+Expression lt(Arguments args) {
+  return compare(args, "<", less_than);
+}
+
+Expression gt(Arguments args) {
+  return compare(args, ">", greater_than);
+}
+
+Expression eq(Arguments args) {
+  return compare(args, "=", equal_to);
+}
+
+// wrap a lambda so calls with identical arguments reuse the first result
+Expression memoize(Arguments args) {
+
+  if (!nargs_equal(args, 1) && !nargs_equal(args, 2)) {
+    throw SemanticError("Error in call to memoize: invalid number of arguments.");
+  }
+  if (!args[0].isHeadLambda() || !args[0].closure()) {
+    throw SemanticError("Error in call to memoize: first argument not a lambda.");
+  }
+
+  std::size_t capacity = MemoCache::defaultCapacity;
+  if (nargs_equal(args, 2)) {
+    double n = args[1].isHeadNumber() ? args[1].head().asNumber() : 0;
+    if (n < 1 || n != std::floor(n)) {
+      throw SemanticError("Error in call to memoize: capacity not a positive integer.");
+    }
+    capacity = static_cast<std::size_t>(n);
+  }
+
+  std::shared_ptr<Closure> closure = std::make_shared<Closure>(*args[0].closure());
+  closure->memo = std::make_shared<MemoCache>(capacity);
+  return args[0].withClosure(closure);
+}
+
+// the counters of a memoized lambda as (hits misses evictions size capacity)
+Expression memo_stats(Arguments args) {
+
+  if (!nargs_equal(args, 1)) {
+    throw SemanticError("Error in call to memo-stats: invalid number of arguments.");
+  }
+  if (!args[0].isHeadLambda() || !args[0].closure() || !args[0].closure()->memo) {
+    throw SemanticError("Error in call to memo-stats: argument not a memoized lambda.");
+  }
+
+  MemoStats stats = args[0].closure()->memo->stats();
+  Expression result(Atom("list"));
+  result.appendExpression(Expression(double(stats.hits)));
+  result.appendExpression(Expression(double(stats.misses)));
+  result.appendExpression(Expression(double(stats.evictions)));
+  result.appendExpression(Expression(double(stats.size)));
+  result.appendExpression(Expression(double(stats.capacity)));
+  return result;
+}
+
+Expression list(Arguments args) {
  
   Expression retList(Atom("list"));
 
@@ -456,7 +804,7 @@ Expression list(const std::vector<Expression> & args) {
   return retList;
 }
 
-Expression first(const std::vector<Expression> & args) {
+Expression first(Arguments args) {
   if(args.size() > 1)
     throw SemanticError("Error: more than one argument in call to first");
   else if (args[0].head().isList()){
@@ -472,7 +820,7 @@ Expression first(const std::vector<Expression> & args) {
   }
 }
 
-Expression rest(const std::vector<Expression> & args) {
+Expression rest(Arguments args) {
   if(args.size() > 1)
     throw SemanticError("Error: more than one argument in call to rest");
   else if (args[0].head().isList()){
@@ -492,7 +840,7 @@ Expression rest(const std::vector<Expression> & args) {
   }
 }
 
-Expression length(const std::vector<Expression> & args) {
+Expression length(Arguments args) {
   if (args.size() > 1) {
     throw SemanticError("Error: more than one argument in call to length");
   }
@@ -508,7 +856,7 @@ Expression length(const std::vector<Expression> & args) {
   }
 }
 
-Expression append(const std::vector<Expression> & args) {
+Expression append(Arguments args) {
   if (args.size() != 2) {
     throw SemanticError("Error: incorrect number of arguments in call to append");
   }
@@ -522,7 +870,7 @@ Expression append(const std::vector<Expression> & args) {
   }  
 }
 
-Expression join(const std::vector<Expression> & args) {
+Expression join(Arguments args) {
   if (args.size() < 2) {
     throw SemanticError("Error: too few arguments in call to join");
   }
@@ -542,7 +890,7 @@ Expression join(const std::vector<Expression> & args) {
   }
 }
 
-Expression range(const std::vector<Expression> & args) {
+Expression range(Arguments args) {
   if (args.size() != 3) {
     throw SemanticError("Error: wrong number arguments in call to range");
   }
@@ -573,7 +921,7 @@ Expression range(const std::vector<Expression> & args) {
   }
 }
 
-Expression applyOnList(const std::vector<Expression> & args) {
+Expression applyOnList(Arguments args) {
   
   if (args.size() != 2) {
     throw SemanticError("Error: wrong number arguments in call to apply");
@@ -595,7 +943,7 @@ Expression applyOnList(const std::vector<Expression> & args) {
   return retProc;
 }
 
-Expression map(const std::vector<Expression> & args) {
+Expression map(Arguments args) {
   if (args.size() != 2) {
     throw SemanticError("Error: wrong number arguments in call to map");
   }
@@ -616,7 +964,7 @@ Expression map(const std::vector<Expression> & args) {
   return retExpr;
 }
 
-Expression set_property(const std::vector<Expression> & args) {
+Expression set_property(Arguments args) {
   if (args.size() != 3) {
     throw SemanticError("Error: wrong number arguments in call to set-property");
   }
@@ -625,13 +973,53 @@ Expression set_property(const std::vector<Expression> & args) {
   }
   
   Expression retExpr(args[2]);
-  //retExpr.pList.insert(std::pair<std::string, Expression>(args[0].head().asSymbol(), args[1]));
-  retExpr.pList[args[0].head().asSymbol()] = args[1];
+  retExpr.setProperty(args[0].head().asSymbol(), args[1]);
 
   return retExpr;
 }
 
-Expression get_property(const std::vector<Expression> & args) {
+Expression make_point(Arguments args) {
+  if (args.size() != 2) {
+    throw SemanticError("Error: wrong number arguments in call to make-point");
+  }
+  return makePoint(args[0], args[1]);
+}
+
+Expression make_line(Arguments args) {
+  if (args.size() != 2) {
+    throw SemanticError("Error: wrong number arguments in call to make-line");
+  }
+  return makeLine(args[0], args[1]);
+}
+
+Expression make_text(Arguments args) {
+  if (args.size() != 1) {
+    throw SemanticError("Error: wrong number arguments in call to make-text");
+  }
+  return makeText(args[0], makePoint(0, 0));
+}
+
+Expression make_polyline(Arguments args) {
+  if (args.size() != 1) {
+    throw SemanticError("Error: wrong number arguments in call to make-polyline");
+  }
+  if (!args[0].isHeadList()) {
+    throw SemanticError("Error: argument to make-polyline not a list of points");
+  }
+  std::vector<double> coordinates;
+  coordinates.reserve(2 * (args[0].tailConstEnd() - args[0].tailConstBegin()));
+  for (auto p = args[0].tailConstBegin(); p != args[0].tailConstEnd(); ++p) {
+    if (!p->isHeadList() || p->tailConstEnd() - p->tailConstBegin() != 2 ||
+        !p->tailConstBegin()->isHeadNumber() || !(p->tailConstBegin() + 1)->isHeadNumber()) {
+      throw SemanticError("Error: argument to make-polyline not a list of points");
+    }
+    coordinates.push_back(p->tailConstBegin()->head().asNumber());
+    coordinates.push_back((p->tailConstBegin() + 1)->head().asNumber());
+  }
+  return makePolyline(std::move(coordinates));
+}
+
+Expression get_property(Arguments args) {
   if (args.size() != 2) {
     throw SemanticError("Error: wrong number arguments in call to get-property");
   }
@@ -639,8 +1027,8 @@ Expression get_property(const std::vector<Expression> & args) {
     throw SemanticError("Error: key is not a string");
   }
   
-  auto pos = args[1].pList.find(args[0].head().asSymbol());
-  if (pos != args[1].pList.end()) {
+  auto pos = args[1].properties().find(args[0].head().asSymbol());
+  if (pos != args[1].properties().end()) {
     return pos->second;
   }
   else {
@@ -654,36 +1042,75 @@ const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const std::complex<double>  I(0,1);
 
+// wait for the value of a future, any other value is its own result
+Expression touch(Arguments args) {
+
+  if (!nargs_equal(args, 1)) {
+    throw SemanticError("Error in call to touch: invalid number of arguments.");
+  }
+  if (!args[0].future()) {
+    return args[0];
+  }
+  return args[0].future()->touch();
+}
+
 
-Environment::Environment(){
+Environment::Environment(): cancel(nullptr){
   reset();
 }
 
+Environment::Environment(std::shared_ptr<Environment> parent):
+  cancel(parent->cancel), background(parent->background), budget(parent->budget), m_parent(parent){
+}
+
+const Environment::EnvResult * Environment::lookup(const Atom & sym) const{
+  if(!sym.isSymbol() && !sym.isList()) return nullptr;
+
+  const std::string & name = sym.asSymbol();
+  for(const Environment * frame = this; frame != nullptr; frame = frame->m_parent.get()){
+    auto result = frame->envmap.find(name);
+    if(result != nullptr){
+      return result;
+    }
+  }
+  return nullptr;
+}
+
 bool Environment::is_known(const Atom & sym) const{
   if(!sym.isSymbol()) return false;
   
-  return envmap.find(sym.asSymbol()) != envmap.end();
+  return lookup(sym) != nullptr;
 }
 
 bool Environment::is_exp(const Atom & sym) const{
   if(!sym.isSymbol()) return false;
   
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ExpressionType);
+  auto result = lookup(sym);
+  return (result != nullptr) && (result->type == ExpressionType);
 }
 
 Expression Environment::get_exp(const Atom & sym) const{
 
   Expression exp;
   
+  auto result = find_exp(sym);
+  if(result != nullptr){
+    exp = *result;
+  }
+
+  return exp;
+}
+
+const Expression * Environment::find_exp(const Atom & sym) const{
+
   if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ExpressionType)){
-      exp = result->second.exp;
+    auto result = lookup(sym);
+    if((result != nullptr) && (result->type == ExpressionType)){
+      return &result->exp;
     }
   }
 
-  return exp;
+  return nullptr;
 }
 
 void Environment::add_exp(const Atom & sym, const Expression & exp){
@@ -692,34 +1119,40 @@ void Environment::add_exp(const Atom & sym, const Expression & exp){
     throw SemanticError("Attempt to add non-symbol to environment");
   }
     
-  // if overwriting symbol map
-  auto pos = envmap.find(sym.asSymbol());
-  if( pos != envmap.end()){
-    envmap.erase(pos);
-  }
-
-  envmap.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp)); 
+  // overwrites any previous mapping of the symbol
+  envmap.assign(sym.asSymbol(), EnvResult(ExpressionType, exp));
 }
 
 bool Environment::is_proc(const Atom & sym) const{
   if(!sym.isSymbol() && !sym.isList()) return false;
   
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ProcedureType);
+  auto result = lookup(sym);
+  return (result != nullptr) && (result->type == ProcedureType);
 }
 
 Procedure Environment::get_proc(const Atom & sym) const{
 
-  if(sym.isSymbol() || sym.isList()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ProcedureType)){
-      return result->second.proc;
-    }
+  auto result = lookup(sym);
+  if((result != nullptr) && (result->type == ProcedureType)){
+    return result->proc;
   }
 
   return default_proc;
 }
 
+std::shared_ptr<Environment> Environment::parent() const{
+  return m_parent;
+}
+
+Environment Environment::snapshot() const{
+
+  Environment result(*this);
+  if(m_parent){
+    result.m_parent = std::make_shared<Environment>(m_parent->snapshot());
+  }
+  return result;
+}
+
 /*
 Reset the environment to the default state. First remove all entries and
 then re-add the default ones.
@@ -758,6 +1191,9 @@ void Environment::reset(){
   // Procedure: map
   envmap.emplace("map", EnvResult(ProcedureType, map));
 
+  // Procedure: parallel-map, evaluated like map but on the thread pool
+  envmap.emplace("parallel-map", EnvResult(ProcedureType, map));
+
   // Procedure: join
   envmap.emplace("join", EnvResult(ProcedureType, join));
 
@@ -767,10 +1203,28 @@ void Environment::reset(){
   envmap.emplace("set-property", EnvResult(ProcedureType, set_property));
   
   envmap.emplace("get-property", EnvResult(ProcedureType, get_property));
+
+  // Procedure: make-point, make-line, make-text and make-polyline, the graphic primitives
+  envmap.emplace("make-point", EnvResult(ProcedureType, make_point));
+  envmap.emplace("make-line", EnvResult(ProcedureType, make_line));
+  envmap.emplace("make-text", EnvResult(ProcedureType, make_text));
+  envmap.emplace("make-polyline", EnvResult(ProcedureType, make_polyline));
   
   // Procedure: add;
   envmap.emplace("+", EnvResult(ProcedureType, add)); 
 
+  // Procedure: fsum, add with compensated summation;
+  envmap.emplace("fsum", EnvResult(ProcedureType, fsum));
+
+  // Procedure: min;
+  envmap.emplace("min", EnvResult(ProcedureType, min));
+
+  // Procedure: max;
+  envmap.emplace("max", EnvResult(ProcedureType, max));
+
+  // Procedure: histogram, bins a list of numbers;
+  envmap.emplace("histogram", EnvResult(ProcedureType, histogram));
+
   // Procedure: subneg;
   envmap.emplace("-", EnvResult(ProcedureType, subneg)); 
 
@@ -813,6 +1267,24 @@ void Environment::reset(){
   //Procedure: arg;
   envmap.emplace("conj", EnvResult(ProcedureType, conj));
 
+  //Procedure: lt;
+  envmap.emplace("<", EnvResult(ProcedureType, lt));
+
+  //Procedure: gt;
+  envmap.emplace(">", EnvResult(ProcedureType, gt));
+
+  //Procedure: eq;
+  envmap.emplace("=", EnvResult(ProcedureType, eq));
+
+  //Procedure: memoize;
+  envmap.emplace("memoize", EnvResult(ProcedureType, memoize));
+
+  //Procedure: memo-stats;
+  envmap.emplace("memo-stats", EnvResult(ProcedureType, memo_stats));
+
+  //Procedure: touch;
+  envmap.emplace("touch", EnvResult(ProcedureType, touch));
+
 }
 
 
@@ -12,19 +12,56 @@ needed.
 
 // system includes
 #include <map>
+#include <memory>
 
 // module includes
 #include "atom.hpp"
 #include "expression.hpp"
-#include "message_queue.h"
-#include <csignal>
-#include <cstdlib>
+#include "cancel_token.hpp"
+#include "persistent_map.hpp"
+
+/*! \class Arguments
+\brief A read-only view of the evaluated arguments of a procedure call.
+
+The view does not own the arguments, they live on the evaluator's argument
+stack (or in the vector it was constructed from) for the duration of the call.
+*/
+class Arguments {
+public:
+
+  /// view the contents of a vector of expressions
+  Arguments(const std::vector<Expression> & args) noexcept
+    : m_first(args.data()), m_size(args.size()) {}
+
+  /// view count expressions starting at first
+  Arguments(const Expression * first, std::size_t count) noexcept
+    : m_first(first), m_size(count) {}
+
+  /// the number of arguments
+  std::size_t size() const noexcept { return m_size; }
+
+  /// true if there are no arguments
+  bool empty() const noexcept { return m_size == 0; }
+
+  /// the argument at position i, which must be less than size()
+  const Expression & operator[](std::size_t i) const noexcept { return m_first[i]; }
+
+  /// iterator to the first argument
+  const Expression * begin() const noexcept { return m_first; }
+
+  /// iterator past the last argument
+  const Expression * end() const noexcept { return m_first + m_size; }
+
+private:
+  const Expression * m_first;
+  std::size_t m_size;
+};
 
 /*! \typedef Procedure
-\brief A Procedure is a C++ function pointer taking a vector of 
-       Expressions as arguments and returning an Expression.
+\brief A Procedure is a C++ function pointer taking a view of the
+       argument Expressions and returning an Expression.
 */
-typedef Expression (*Procedure)(const std::vector<Expression> & args);
+typedef Expression (*Procedure)(Arguments args);
 
 /*! \class Environment
 \brief A class representing the interpreter environment.
@@ -47,21 +84,32 @@ public:
    * definitions. */
   Environment();
   //~Environment();
+
+  /*! Construct an empty local frame chained to a parent environment.
+    Lookups that miss in this frame continue in the parent, definitions
+    are added to this frame only.
+    \param parent the enclosing environment
+   */
+  explicit Environment(std::shared_ptr<Environment> parent);
   
-  //DEEP COPY 
-  Environment(const Environment & env) {
+  /*! Copy a frame in O(1), the copy shares the current version of its
+      definitions and its parent. Definitions added to either afterwards
+      are not seen by the other.
+   */
+  Environment(const Environment & env):
+    cancel(env.cancel), background(env.background), budget(env.budget), envmap(env.envmap.snapshot()), m_parent(env.m_parent) {}
 
-    for(auto &p : env.envmap)
-    {
-      envmap.emplace(p);
-    }
-    
-    interruptQ = env.interruptQ;
-  }
+  /// raised to interrupt evaluations in this environment, may be nullptr
+  const CancelToken * cancel;
 
-  message_queue<bool> * interruptQ;
+  /// polled by the futures started in this environment, which outlive the
+  /// evaluation: raised with cancel and when the interpreter is reset or
+  /// destroyed, may be empty to poll cancel alone
+  std::shared_ptr<const CancelToken> background;
 
-  bool testing;
+  /// the limits of the evaluation this frame belongs to, which evaluations
+  /// started in it without limits of their own count against, may be empty
+  std::shared_ptr<EvalBudget> budget;
 
   /*! Determine if a symbol is known to the environment.
     \param sym the sumbol to lookup
@@ -82,6 +130,12 @@ public:
   */
   Expression get_exp(const Atom &sym) const;
 
+  /*! Find the Expression the argument symbol maps to without copying it.
+    \param sym the symbol to lookup
+    \return a pointer to the mapped expression or nullptr if there is none
+  */
+  const Expression * find_exp(const Atom &sym) const;
+
   /*! Add a mapping from sym argument to the exp argument within the environment.
     \param sym the symbol to add
     \param exp the expression the symbol should map to
@@ -109,6 +163,17 @@ public:
   /*! Reset the environment to its default state. */
   void reset();
 
+  /// return the enclosing environment of a local frame, or nullptr
+  std::shared_ptr<Environment> parent() const;
+
+  /*! Take a consistent read-only view of this frame and the frames it is
+      chained to. It costs O(1) per frame and never waits for a writer, so
+      other threads may take one while the owner of this environment goes
+      on defining; definitions made after it are not seen by it.
+    \return a copy whose frames share no mutable state with this one
+   */
+  Environment snapshot() const;
+
 private:
   // Environment is a mapping from symbols to expressions or procedures
   enum EnvResultType { ExpressionType, ProcedureType };
@@ -123,13 +188,19 @@ private:
     EnvResult(EnvResultType t, Expression e) : type(t), exp(e) {};
     EnvResult(EnvResultType t, Procedure p) : type(t), proc(p) {};
   };
-  // the environment map
-  std::map<std::string, EnvResult> envmap;
+  // the environment map, only its owner writes it, copies share its nodes
+  PersistentMap<EnvResult> envmap;
+
+  // the enclosing environment, null for the global environment
+  std::shared_ptr<Environment> m_parent;
+
+  // find the entry for a symbol in this frame or the enclosing ones
+  const EnvResult * lookup(const Atom &sym) const;
 };
 
-Expression list(const std::vector<Expression> & args); 
-Expression applyOnList(const std::vector<Expression> & args);
-Expression map(const std::vector<Expression>& args);
-//Expression length(const std::vector<Expression>& args);
+Expression list(Arguments args); 
+Expression applyOnList(Arguments args);
+Expression map(Arguments args);
+//Expression length(Arguments args);
 
 #endif
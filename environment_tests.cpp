@@ -2,8 +2,12 @@
 
 #include "environment.hpp"
 #include "semantic_error.hpp"
+#include "thread_pool.hpp"
 
+#include <atomic>
 #include <cmath>
+#include <string>
+#include <thread>
 
 TEST_CASE( "Test default constructor", "[environment]" ) {
 
@@ -60,7 +64,7 @@ TEST_CASE( "Test add expression", "[environment]" ) {
   REQUIRE(env.is_exp(Atom("hi")));
   REQUIRE(env.get_exp(Atom("hi")) == b);
 
-  REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), b), SemanticError);
+  REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), b), const SemanticError &);
 }
 
 TEST_CASE( "Test get built-in procedure", "[environment]" ) {
@@ -93,7 +97,7 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     args.clear();
     args.emplace_back(std::complex<double>(0., 1.0));
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(padd(args), SemanticError);
+    REQUIRE_THROWS_AS(padd(args), const SemanticError &);
   }
 
   {
@@ -105,7 +109,7 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     args.emplace_back(2.0);
     REQUIRE(pmult(args) == Expression(std::complex<double>(0., 2.0)));
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pmult(args), SemanticError);
+    REQUIRE_THROWS_AS(pmult(args), const SemanticError &);
   }
 
   {
@@ -133,10 +137,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(ppow(args) == Expression(std::complex<double>(0.2078795763507619085469556198349787,0)));
 
     args.emplace_back(std::complex<double>(0., 1.0));
-    REQUIRE_THROWS_AS(ppow(args), SemanticError);
+    REQUIRE_THROWS_AS(ppow(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(ppow(args), SemanticError);
+    REQUIRE_THROWS_AS(ppow(args), const SemanticError &);
 
   }
 
@@ -174,10 +178,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pneg(args) == Expression(std::complex<double>(0.0, 1.0)));
     
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pneg(args), SemanticError);
+    REQUIRE_THROWS_AS(pneg(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pneg(args), SemanticError);
+    REQUIRE_THROWS_AS(pneg(args), const SemanticError &);
 
   }
 
@@ -201,10 +205,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     args.clear();
     args.emplace_back(-1.0);
     args.emplace_back(-1.0);
-    REQUIRE_THROWS_AS(psqrt(args), SemanticError);
+    REQUIRE_THROWS_AS(psqrt(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(psqrt(args), SemanticError);
+    REQUIRE_THROWS_AS(psqrt(args), const SemanticError &);
   }
 
   {
@@ -233,7 +237,7 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pdiv(args) == Expression(std::complex<double>(0.4, 0.8)));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pdiv(args), SemanticError);
+    REQUIRE_THROWS_AS(pdiv(args), const SemanticError &);
 
     args.clear();
     args.emplace_back(2);
@@ -263,15 +267,15 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pln(args) == Expression(0.0));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pln(args), SemanticError);
+    REQUIRE_THROWS_AS(pln(args), const SemanticError &);
 
     args.clear();
     args.emplace_back(-1.0);
-    REQUIRE_THROWS_AS(pln(args), SemanticError);
+    REQUIRE_THROWS_AS(pln(args), const SemanticError &);
 
     args.clear();
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pln(args), SemanticError);
+    REQUIRE_THROWS_AS(pln(args), const SemanticError &);
   }
 
   {
@@ -283,11 +287,11 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(psin(args) == Expression(0.));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(psin(args), SemanticError);
+    REQUIRE_THROWS_AS(psin(args), const SemanticError &);
 
     args.clear();
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(psin(args), SemanticError);
+    REQUIRE_THROWS_AS(psin(args), const SemanticError &);
   }
 
   {
@@ -299,10 +303,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pcos(args) == Expression(1));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pcos(args), SemanticError);
+    REQUIRE_THROWS_AS(pcos(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pcos(args), SemanticError);
+    REQUIRE_THROWS_AS(pcos(args), const SemanticError &);
   }
 
   {
@@ -314,10 +318,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(ptan(args) == Expression(0));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(ptan(args), SemanticError);
+    REQUIRE_THROWS_AS(ptan(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(ptan(args), SemanticError);
+    REQUIRE_THROWS_AS(ptan(args), const SemanticError &);
   }
 
   {
@@ -330,10 +334,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(preal(args) == Expression(2));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(preal(args), SemanticError);
+    REQUIRE_THROWS_AS(preal(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(preal(args), SemanticError);
+    REQUIRE_THROWS_AS(preal(args), const SemanticError &);
   }
 
   {
@@ -346,10 +350,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pimag(args) == Expression(1.));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pimag(args), SemanticError);
+    REQUIRE_THROWS_AS(pimag(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pimag(args), SemanticError);
+    REQUIRE_THROWS_AS(pimag(args), const SemanticError &);
   }
 
   {
@@ -366,10 +370,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pmag(args) == Expression(1));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pmag(args), SemanticError);
+    REQUIRE_THROWS_AS(pmag(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pmag(args), SemanticError);
+    REQUIRE_THROWS_AS(pmag(args), const SemanticError &);
   }
 
   {
@@ -382,10 +386,10 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(parg(args) == Expression(0.24497866312686415));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(parg(args), SemanticError);
+    REQUIRE_THROWS_AS(parg(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(parg(args), SemanticError);
+    REQUIRE_THROWS_AS(parg(args), const SemanticError &);
   }
 
   {
@@ -398,15 +402,33 @@ TEST_CASE( "Test get built-in procedure", "[environment]" ) {
     REQUIRE(pconj(args) == Expression(std::complex<double>(4.0, -1.0)));
 
     args.emplace_back(std::complex<double>(0.0, 1.0));
-    REQUIRE_THROWS_AS(pconj(args), SemanticError);
+    REQUIRE_THROWS_AS(pconj(args), const SemanticError &);
 
     args.emplace_back(Atom("asdf"));
-    REQUIRE_THROWS_AS(pconj(args), SemanticError);
+    REQUIRE_THROWS_AS(pconj(args), const SemanticError &);
   }
 
 }
 
 
+TEST_CASE( "Test procedure arguments view", "[environment]" ) {
+  Environment env;
+
+  Expression stack[] = {Expression(1.0), Expression(2.0), Expression(3.0), Expression(4.0)};
+
+  Arguments middle(stack + 1, 2);
+  REQUIRE(middle.size() == 2);
+  REQUIRE(!middle.empty());
+  REQUIRE(middle[0] == Expression(2.0));
+  REQUIRE(middle[1] == Expression(3.0));
+  REQUIRE(middle.end() - middle.begin() == 2);
+
+  Procedure padd = env.get_proc(Atom("+"));
+  REQUIRE(padd(middle) == Expression(5.0));
+  REQUIRE(padd(Arguments(stack, 4)) == Expression(10.0));
+  REQUIRE(Arguments(stack, 0).empty());
+}
+
 TEST_CASE( "Test reset", "[environment]" ) {
   Environment env;
 
@@ -453,7 +475,7 @@ TEST_CASE( "Testing lists", "[environment]" ) {
     REQUIRE(pfirst(vec) == Expression(std::complex<double>(4.0, 1.0)));
 
     vec.push_back(list);
-    REQUIRE_THROWS_AS(pfirst(vec), SemanticError);    
+    REQUIRE_THROWS_AS(pfirst(vec), const SemanticError &);    
   }
 
   {
@@ -481,10 +503,10 @@ TEST_CASE( "Testing lists", "[environment]" ) {
     REQUIRE( rest == plist(args2));
     
     vec.push_back(list);
-    REQUIRE_THROWS_AS(pRest(vec), SemanticError);
+    REQUIRE_THROWS_AS(pRest(vec), const SemanticError &);
 
     //vec = {};
-    //REQUIRE_THROWS_AS(pRest(vec), SemanticError);
+    //REQUIRE_THROWS_AS(pRest(vec), const SemanticError &);
     
   }
   {
@@ -507,10 +529,10 @@ TEST_CASE( "Testing lists", "[environment]" ) {
 
     listVec.push_back(list);
 
-    REQUIRE_THROWS_AS(plength(listVec), SemanticError);
+    REQUIRE_THROWS_AS(plength(listVec), const SemanticError &);
     
     listVec[0] = Expression(Atom(1));
-    REQUIRE_THROWS_AS(plength(listVec), SemanticError);
+    REQUIRE_THROWS_AS(plength(listVec), const SemanticError &);
 
   }  
   
@@ -542,10 +564,10 @@ TEST_CASE( "Testing lists", "[environment]" ) {
     REQUIRE(fullList == list);
 
     inputVector[0] = Expression(Atom(1));
-    REQUIRE_THROWS_AS(pAppend(inputVector), SemanticError);
+    REQUIRE_THROWS_AS(pAppend(inputVector), const SemanticError &);
 
     inputVector.push_back(list);
-    REQUIRE_THROWS_AS(pAppend(inputVector), SemanticError);
+    REQUIRE_THROWS_AS(pAppend(inputVector), const SemanticError &);
   }
   {
     INFO("trying join procedure")
@@ -570,7 +592,7 @@ TEST_CASE( "Testing lists", "[environment]" ) {
     REQUIRE(list12 == list3);
     
     joinInput.pop_back();
-    REQUIRE_THROWS_AS(pJoin(joinInput), SemanticError);
+    REQUIRE_THROWS_AS(pJoin(joinInput), const SemanticError &);
   }
   
   {
@@ -594,10 +616,10 @@ TEST_CASE( "Testing lists", "[environment]" ) {
     REQUIRE(lhs == rhs);
             
     rangeinput.pop_back();
-    REQUIRE_THROWS_AS(pRange(rangeinput), SemanticError);
+    REQUIRE_THROWS_AS(pRange(rangeinput), const SemanticError &);
 
     rangeinput.emplace_back(-1.);
-    REQUIRE_THROWS_AS(pRange(rangeinput), SemanticError);
+    REQUIRE_THROWS_AS(pRange(rangeinput), const SemanticError &);
   }
   
   //{
@@ -625,11 +647,11 @@ TEST_CASE( "Testing lists", "[environment]" ) {
 
   //  
   //  listIn.pop_back();
-  //  REQUIRE_THROWS_AS(pApply(inputVec), SemanticError);
+  //  REQUIRE_THROWS_AS(pApply(inputVec), const SemanticError &);
 
   //  listIn.emplace_back(2.0);
   //  //rangeinput.emplace_back(-1.);
-  //  REQUIRE_THROWS_AS(pApply(inputVec), SemanticError);
+  //  REQUIRE_THROWS_AS(pApply(inputVec), const SemanticError &);
   //}
 
 }
@@ -655,6 +677,98 @@ TEST_CASE("Testing copying the map", "[environment]") {
   REQUIRE(env.get_exp(Atom("I")) == env2.get_exp(Atom("I")));
 }
 
+TEST_CASE("Testing persistent map versions", "[environment]") {
+
+  PersistentMap<int> map;
+  for(int i = 0; i < 2000; ++i){
+    REQUIRE(map.emplace("k" + std::to_string(i), i));
+  }
+  REQUIRE(!map.emplace("k7", -1));
+
+  PersistentMap<int> old = map.snapshot();
+  map.assign("k7", 70);
+  map.assign("new", 1);
+
+  REQUIRE(*map.find("k7") == 70);
+  REQUIRE(*old.find("k7") == 7);
+  REQUIRE(map.find("new") != nullptr);
+  REQUIRE(old.find("new") == nullptr);
+
+  int count = 0;
+  long total = 0;
+  old.forEach([&count, &total](const std::string &, int v){ ++count; total += v; });
+  REQUIRE(count == 2000);
+  REQUIRE(total == 1999 * 1000);
+
+  map.clear();
+  REQUIRE(map.find("k1") == nullptr);
+  REQUIRE(*old.find("k1") == 1);
+
+  INFO("another thread may read the map while its owner writes");
+  std::atomic<bool> done(false);
+  std::atomic<bool> consistent(true);
+  std::thread reader([&map, &done, &consistent](){
+    while(!done){
+      // keys are added in order, so one missing key means none after it
+      int known = 0;
+      while(map.find("r" + std::to_string(known)) != nullptr) ++known;
+      int seen = 0;
+      map.forEach([&seen](const std::string &, int){ ++seen; });
+      if(seen < known) consistent = false;
+    }
+  });
+  for(int i = 0; i < 2000; ++i){
+    map.assign("r" + std::to_string(i), i);
+  }
+  done = true;
+  reader.join();
+  REQUIRE(consistent);
+}
+
+TEST_CASE("Testing environment snapshots", "[environment]") {
+
+  Environment env;
+  env.add_exp(Atom("a"), Expression(1.));
+
+  std::shared_ptr<Environment> global = std::make_shared<Environment>(env);
+  Environment local(global);
+  local.add_exp(Atom("b"), Expression(2.));
+
+  Environment view = local.snapshot();
+  global->add_exp(Atom("a"), Expression(10.));
+  global->add_exp(Atom("c"), Expression(3.));
+  local.add_exp(Atom("b"), Expression(20.));
+
+  INFO("a snapshot keeps the definitions of every frame when it was taken");
+  REQUIRE(view.get_exp(Atom("a")) == Expression(1.));
+  REQUIRE(view.get_exp(Atom("b")) == Expression(2.));
+  REQUIRE(!view.is_known(Atom("c")));
+  REQUIRE(view.is_proc(Atom("+")));
+  REQUIRE(local.get_exp(Atom("a")) == Expression(10.));
+
+  INFO("snapshots taken while another thread defines are consistent");
+  std::atomic<bool> done(false);
+  std::atomic<bool> consistent(true);
+  std::thread reader([global, &done, &consistent](){
+    while(!done){
+      Environment seen = global->snapshot();
+      // entries are defined in order, so a view without s_i has none after it
+      int known = 0;
+      while(seen.is_exp(Atom("s" + std::to_string(known)))) ++known;
+      for(int i = known; i < known + 8; ++i){
+        if(seen.is_known(Atom("s" + std::to_string(i)))) consistent = false;
+      }
+    }
+  });
+  for(int i = 0; i < 500; ++i){
+    global->add_exp(Atom("s" + std::to_string(i)), Expression(double(i)));
+  }
+  done = true;
+  reader.join();
+  REQUIRE(consistent);
+  REQUIRE(global->get_exp(Atom("s499")) == Expression(499.));
+}
+
 //TEST_CASE("Testing lambda function", "[environment]") {
 //  using namespace std;
 //  Environment env;
@@ -665,3 +779,138 @@ TEST_CASE("Testing copying the map", "[environment]") {
 //
 //}
 
+
+TEST_CASE( "Test reductions over many arguments", "[environment]" ) {
+
+  Environment env;
+  Procedure padd = env.get_proc(Atom("+"));
+  Procedure pfsum = env.get_proc(Atom("fsum"));
+  Procedure pmul = env.get_proc(Atom("*"));
+  Procedure pmin = env.get_proc(Atom("min"));
+  Procedure pmax = env.get_proc(Atom("max"));
+
+  // several chunks of values whose sum depends on the order of addition
+  std::vector<Expression> args;
+  for(int i = 0; i < 20000; ++i){
+    args.emplace_back((i % 2 ? -1.0 : 1.0) * (1.0 + i * 1e-7) * ((i % 3) ? 1e10 : 1e-3));
+  }
+
+  Expression sequential = padd(args);
+  Expression compensated = pfsum(args);
+  Expression lowest = pmin(args);
+  Expression highest = pmax(args);
+
+  for(std::size_t workers : {1, 2, 5}){
+    INFO("the result does not depend on " << workers << " workers");
+    ThreadPool pool(workers);
+    ThreadPool::Scope scope(&pool);
+    REQUIRE(padd(args).head().asNumber() == sequential.head().asNumber());
+    REQUIRE(pfsum(args).head().asNumber() == compensated.head().asNumber());
+    REQUIRE(pmin(args) == lowest);
+    REQUIRE(pmax(args) == highest);
+  }
+
+  {
+    INFO("compensated summation keeps the low-order terms");
+    std::vector<Expression> cancel = {Expression(1e16), Expression(1.0), Expression(-1e16)};
+    REQUIRE(padd(cancel) == Expression(0.));
+    REQUIRE(pfsum(cancel) == Expression(1.));
+  }
+
+  {
+    INFO("complex numbers and errors");
+    std::vector<Expression> mixed = {Expression(2.0), Expression(std::complex<double>(0, 1)), Expression(3.0)};
+    REQUIRE(padd(mixed) == Expression(std::complex<double>(5, 1)));
+    REQUIRE(pfsum(mixed) == Expression(std::complex<double>(5, 1)));
+    REQUIRE(pmul(mixed) == Expression(std::complex<double>(0, 6)));
+    REQUIRE_THROWS_AS(pmin(mixed), const SemanticError &);
+    REQUIRE_THROWS_AS(pmax(std::vector<Expression>()), const SemanticError &);
+
+    std::vector<Expression> bad(10000, Expression(1.0));
+    bad[9000] = Expression(Atom("a"));
+    ThreadPool pool(3);
+    ThreadPool::Scope scope(&pool);
+    REQUIRE_THROWS_AS(padd(bad), const SemanticError &);
+    REQUIRE_THROWS_AS(pmul(bad), const SemanticError &);
+  }
+}
+
+TEST_CASE( "Test histogram", "[environment]" ) {
+
+  Environment env;
+  Procedure phist = env.get_proc(Atom("histogram"));
+
+  auto numbers = [](std::vector<double> values){
+    Expression list(Atom("list"));
+    for(double v : values) list.append(Atom(v));
+    return list;
+  };
+  auto option = [](const std::string & key, const Expression & value){
+    Expression o(Atom("list"));
+    o.append(Atom("\"" + key + "\""));
+    o.appendExpression(value);
+    return o;
+  };
+  auto bar = [](double center, double height){
+    Expression b(Atom("list"));
+    b.append(Atom(center));
+    b.append(Atom(height));
+    return b;
+  };
+
+  {
+    INFO("bins split the extent of the data, the last includes the maximum");
+    Expression opts(Atom("list"));
+    opts.appendExpression(option("bins", Expression(2.)));
+    std::vector<Expression> args = {numbers({0, 1, 1, 3, 4}), opts};
+    Expression bars = phist(args);
+    std::vector<Expression> expected = {bar(1, 3), bar(3, 2)};
+    REQUIRE(std::equal(bars.tailConstBegin(), bars.tailConstEnd(), expected.begin()));
+    REQUIRE(bars.tailConstEnd() - bars.tailConstBegin() == 2);
+  }
+
+  {
+    INFO("explicit edges drop values outside them, density divides by count and width");
+    Expression opts(Atom("list"));
+    opts.appendExpression(option("edges", numbers({0, 1, 3})));
+    opts.appendExpression(option("density", Expression(1.)));
+    std::vector<Expression> args = {numbers({-1, 0.5, 1, 2, 2.5, 9}), opts};
+    Expression bars = phist(args);
+    std::vector<Expression> expected = {bar(0.5, 0.25), bar(2, 0.375)};
+    REQUIRE(std::equal(bars.tailConstBegin(), bars.tailConstEnd(), expected.begin()));
+  }
+
+  {
+    INFO("the counts do not depend on the number of workers");
+    std::vector<double> values;
+    for(int i = 0; i < 20000; ++i) values.push_back(std::sin(i * 0.37));
+    std::vector<Expression> args = {numbers(values)};
+    Expression sequential = phist(args);
+    double total = 0;
+    for(auto b = sequential.tailConstBegin(); b != sequential.tailConstEnd(); ++b){
+      total += (b->tailConstBegin() + 1)->head().asNumber();
+    }
+    REQUIRE(total == 20000);
+    REQUIRE(sequential.tailConstEnd() - sequential.tailConstBegin() == 10);
+
+    ThreadPool pool(3);
+    ThreadPool::Scope scope(&pool);
+    REQUIRE(phist(args) == sequential);
+  }
+
+  {
+    INFO("bad data and options");
+    std::vector<Expression> empty = {numbers({})};
+    REQUIRE_THROWS_AS(phist(empty), const SemanticError &);
+    std::vector<Expression> complex = {Expression(Atom("list"))};
+    complex[0].append(Atom(std::complex<double>(0, 1)));
+    REQUIRE_THROWS_AS(phist(complex), const SemanticError &);
+    for(Expression bad : {option("bins", Expression(0.)), option("bins", Expression(2.5)), option("bins", Expression(1e12)),
+	  option("edges", numbers({1, 1})), option("edges", numbers({1})), option("colour", Expression(1.))}){
+      Expression opts(Atom("list"));
+      opts.appendExpression(bad);
+      std::vector<Expression> args = {numbers({1, 2}), opts};
+      REQUIRE_THROWS_AS(phist(args), const SemanticError &);
+    }
+  }
+}
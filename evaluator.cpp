@@ -0,0 +1,664 @@
+#include "evaluator.hpp"
+
+#include <exception>
+#include <future>
+#include <string>
+
+#include "environment.hpp"
+#include "future.hpp"
+#include "memo.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+Expression apply(const Atom & op, Arguments args, const Environment & env){
+
+  // head must be a symbol or a list
+  if(!op.isSymbol() && !op.isList()){
+    throw SemanticError("Error during evaluation: procedure name not symbol");
+  }
+
+  // must map to a proc
+  if (!env.is_proc(op)) {
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda function");
+  }
+
+  // map from symbol to proc
+  Procedure proc = env.get_proc(op);
+
+  // call proc with args
+  return proc(args);
+}
+
+// evaluate each call of a map on the pool, keeping the results in order
+Expression parallelMap(const Expression & calls, const Environment & env, const std::shared_ptr<EvalBudget> & budget, ThreadPool & pool){
+
+  // the tasks share a snapshot of the calling frames, each defines in its own
+  // frame over it, so nothing they run can change the caller's environment;
+  // they count against the caller's budget
+  std::shared_ptr<Environment> snapshot = std::make_shared<Environment>(env.snapshot());
+  snapshot->budget = budget;
+
+  std::vector<std::future<Expression>> results;
+  for(auto call = calls.tailConstBegin(); call != calls.tailConstEnd(); ++call){
+    const Expression & exp = *call;
+    results.push_back(pool.submit([snapshot, exp](){
+	  Environment local(snapshot);
+	  Evaluator evaluator;
+	  return evaluator.run(exp, local);
+	}, env.cancel));
+  }
+
+  // wait for every task before reporting an error, so none outlives the call
+  Expression list(Atom("list"));
+  std::exception_ptr error;
+  for(auto & result : results){
+    try{
+      list.appendExpression(pool.wait(result));
+    }
+    catch(...){
+      if(!error) error = std::current_exception();
+    }
+  }
+  if(error){
+    std::rethrow_exception(error);
+  }
+  return list;
+}
+
+// the environment a call of closure binds its arguments over
+std::shared_ptr<Environment> scopeOf(const Closure & closure, const std::shared_ptr<Environment> & global){
+  if(closure.owner){
+    return closure.owner;
+  }
+  std::shared_ptr<Environment> scope = closure.scope.lock();
+  if(scope){
+    return scope;
+  }
+  // an empty scope is the global one, an expired one must not become it
+  if(closure.scope.owner_before(std::weak_ptr<Environment>()) ||
+     std::weak_ptr<Environment>().owner_before(closure.scope)){
+    throw SemanticError("Error in call to function: the environment of the lambda no longer exists");
+  }
+  return global;
+}
+
+// the value (define name (lambda ...)) binds in a local frame: the lambda
+// captured the frame before name was bound, so it gets a scope of its own
+// holding name for recursion. That binding refers to the scope without
+// owning it and the value owns it, so the scope and its binding are no cycle.
+Expression recursive(const Expression & value, const Atom & name){
+  const std::shared_ptr<const Closure> & closure = value.closure();
+  if(!closure || !closure->owner){
+    return value;
+  }
+  std::shared_ptr<Environment> self = std::make_shared<Environment>(closure->owner);
+
+  std::shared_ptr<Closure> binding = std::make_shared<Closure>(*closure);
+  binding->scope = self;
+  binding->owner.reset();
+  self->add_exp(name, value.withClosure(binding));
+
+  std::shared_ptr<Closure> owned = std::make_shared<Closure>(*closure);
+  owned->scope = self;
+  owned->owner = self;
+  return value.withClosure(owned);
+}
+
+// the value a lookup in a local environment yields: a recursive lambda taken
+// out of its own scope owns it again, as it may outlive every call of it
+Expression owning(Expression value){
+  const std::shared_ptr<const Closure> & closure = value.closure();
+  if(!closure || closure->owner){
+    return value;
+  }
+  std::shared_ptr<Environment> scope = closure->scope.lock();
+  if(!scope){
+    return value;
+  }
+  std::shared_ptr<Closure> owned = std::make_shared<Closure>(*closure);
+  owned->owner = std::move(scope);
+  return value.withClosure(owned);
+}
+
+// start evaluating exp in the background over a standalone copy of env
+Expression makeFuture(const Expression & exp, const std::shared_ptr<Environment> & env, const std::shared_ptr<EvalBudget> & budget){
+
+  // the task may run past the evaluation, so it polls the background token,
+  // which the task keeps alive, and so do the futures it starts
+  std::shared_ptr<const CancelToken> stop = env->background ? env->background :
+    std::shared_ptr<const CancelToken>(std::shared_ptr<const CancelToken>(), env->cancel);
+
+  // the caller goes on defining while the task runs, so it reads a snapshot;
+  // the lambdas it calls read the snapshots they captured. It counts against
+  // the caller's budget, which ends with the caller's deadline
+  std::shared_ptr<Environment> snapshot = std::make_shared<Environment>(env->snapshot());
+  snapshot->cancel = stop.get();
+  snapshot->background = stop;
+  snapshot->budget = budget;
+  auto task = [snapshot, stop, exp](){
+    Evaluator evaluator;
+    return evaluator.run(exp, *snapshot);
+  };
+
+  // without a pool (evaluation outside an Interpreter) it runs when touched
+  std::shared_ptr<Future> future = std::make_shared<Future>();
+  future->pool = ThreadPool::current();
+  if(future->pool != nullptr){
+    future->result = future->pool->submit(task, stop.get()).share();
+  }
+  else{
+    future->result = std::async(std::launch::deferred, task).share();
+  }
+  return Expression(Atom("future")).withFuture(future);
+}
+
+bool isSpecialForm(const std::string & s){
+  return (s == "define") || (s == "begin") || (s == "lambda") || (s == "if") || (s == "future");
+}
+
+} // namespace
+
+namespace {
+
+// reading the clock costs far more than a step, so only look every so often
+const std::size_t clockInterval = 1024;
+
+} // namespace
+
+Expression Evaluator::run(const Expression & exp, Environment & env, const EvalLimits & limits){
+
+  start(env, limits);
+  push(&exp, m_global);
+  return loop();
+}
+
+Expression Evaluator::call(const Expression & function, Arguments args, Environment & env, const EvalLimits & limits){
+
+  start(env, limits);
+
+  if(!function.isHeadLambda()){
+    Expression value = apply(function.head(), args, env);
+    m_global.reset();
+    return value;
+  }
+
+  std::shared_ptr<const Closure> closure = function.closure();
+  if(!closure){
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda function");
+  }
+  if(args.size() != closure->params.size()){
+    throw SemanticError("Error in call to function: invalid number of arguments.");
+  }
+
+  Expression value;
+  if(closure->memo && closure->memo->find(args, value)){
+    m_global.reset();
+    return value;
+  }
+
+  push(&closure->body, callFrame(*closure, args));
+  m_stack.back().closure = closure;
+
+  value = loop();
+  if(closure->memo){
+    closure->memo->insert(args, value);
+  }
+  return value;
+}
+
+void Evaluator::start(Environment & env, const EvalLimits & limits){
+
+  m_stack.clear();
+  m_args.clear();
+
+  m_cancel = env.cancel;
+  m_steps = 0;
+
+  // without limits of its own a task counts against the evaluation that started it
+  m_budget = limits.bounded() ? std::make_shared<EvalBudget>(limits) : env.budget;
+
+  // the caller owns env, so share it without taking ownership
+  m_global = std::shared_ptr<Environment>(std::shared_ptr<Environment>(), &env);
+}
+
+Expression Evaluator::loop(){
+
+  Expression value;
+
+  while(!m_stack.empty()){
+    Frame & frame = m_stack.back();
+
+    bool done = (frame.state == Frame::Enter) ? enter(frame, value) : resume(frame, value);
+
+    if(done){
+      m_stack.pop_back();
+    }
+  }
+
+  m_global.reset();
+
+  return value;
+}
+
+void Evaluator::push(const Expression * node, std::shared_ptr<Environment> env){
+  m_stack.emplace_back();
+  Frame & frame = m_stack.back();
+  frame.node = node;
+  frame.env = std::move(env);
+  frame.state = Frame::Enter;
+  frame.next = 0;
+  frame.base = m_args.size();
+  frame.memo.reset();
+}
+
+void Evaluator::replace(Frame & frame, const Expression * node){
+  frame.node = node;
+  frame.state = Frame::Enter;
+  frame.next = 0;
+}
+
+void Evaluator::replace(Frame & frame, Expression && exp){
+  // the old node may live in the owned storage, so build before swapping
+  std::unique_ptr<Expression> owned(new Expression(std::move(exp)));
+  replace(frame, owned.get());
+  frame.owned = std::move(owned);
+}
+
+void Evaluator::poll(){
+
+  if(m_cancel != nullptr && m_cancel->cancelled()){
+    throw SemanticError("Error: interpreter kernel interrupted");
+  }
+
+  if(!m_budget){
+    return;
+  }
+
+  if(!m_budget->step()){
+    throw SemanticError("Error: evaluation exceeded its step budget");
+  }
+
+  if((++m_steps % clockInterval == 0) && m_budget->expired()){
+    throw SemanticError("Error: evaluation exceeded its deadline");
+  }
+}
+
+bool Evaluator::enter(Frame & frame, Expression & value){
+
+  poll();
+
+  const Expression * node = frame.node;
+  const Atom & head = node->head();
+  const std::vector<Expression> & tail = node->m_tail;
+
+  // asSymbol copies the string, so fetch it once per node
+  const std::string name = head.asSymbol();
+
+  if (name == "apply") {
+    if (tail.size() != 2) {
+      throw SemanticError("Error: wrong number arguments in call to apply");
+    }
+    frame.state = Frame::ApplyList;
+    frame.base = m_args.size();
+    startProcedure(frame);
+    return false;
+  }
+  if (name == "map") {
+    if (tail.size() != 2) {
+      throw SemanticError("Error: wrong number arguments in call to map");
+    }
+    frame.state = Frame::MapList;
+    frame.base = m_args.size();
+    startProcedure(frame);
+    return false;
+  }
+  if (name == "parallel-map") {
+    if (tail.size() != 2) {
+      throw SemanticError("Error: wrong number arguments in call to parallel-map");
+    }
+    frame.state = Frame::ParallelMapList;
+    frame.base = m_args.size();
+    startProcedure(frame);
+    return false;
+  }
+  if (name == "discrete-plot" || name == "density-plot") {
+    if(tail.size() != 2)
+      throw SemanticError("Error in call to " + name + ": invalid number of lists.");
+    frame.state = Frame::Plot;
+    frame.base = m_args.size();
+    frame.next = 1;
+    push(&tail[0], frame.env);
+    return false;
+  }
+  if (name == "continuous-plot") {
+    if (tail.size() != 2 && tail.size() != 3)
+      throw SemanticError("Error in call to continuous-plot: invalid number of inputs. You have: " + std::to_string(tail.size()) + " inputs.");
+    frame.state = Frame::Plot;
+    frame.base = m_args.size();
+    // a built-in procedure has no value of its own, it is passed on by name
+    if(tail[0].m_tail.empty() && frame.env->is_proc(tail[0].head())){
+      m_args.push_back(tail[0]);
+      frame.next = 2;
+      push(&tail[1], frame.env);
+    }
+    else{
+      frame.next = 1;
+      push(&tail[0], frame.env);
+    }
+    return false;
+  }
+
+  if (name == "future" && !node->m_future) {
+    if (tail.size() != 1) {
+      throw SemanticError("Error: wrong number arguments in call to future");
+    }
+    value = makeFuture(tail[0], frame.env, m_budget);
+    return true;
+  }
+
+  if(tail.empty()){
+    // a future or polyline value placed in a call by map or apply stands for itself
+    if (node->m_future || node->m_packed)
+      value = *node;
+    else if (!name.empty() && name[0] == '"' && name[name.size()-1] == '"')
+      value = *node;
+    else if (frame.env != m_global)
+      value = owning(node->handle_lookup(head, *frame.env));
+    else
+      value = node->handle_lookup(head, *frame.env);
+    return true;
+  }
+
+  if(head.isSymbol() && name == "begin"){
+    frame.state = Frame::Sequence;
+    frame.next = 1;
+    if(tail.size() == 1){
+      replace(frame, &tail[0]);
+    }
+    else{
+      push(&tail[0], frame.env);
+    }
+    return false;
+  }
+
+  if(head.isSymbol() && name == "define"){
+
+    // tail must have size 2 or error
+    if(tail.size() != 2){
+      throw SemanticError("Error during evaluation: invalid number of arguments to define");
+    }
+
+    // tail[0] must be symbol
+    if(!tail[0].isHeadSymbol()){
+      throw SemanticError("Error during evaluation: first argument to define not symbol");
+    }
+
+    // but tail[0] must not be a special-form or procedure
+    if(isSpecialForm(tail[0].head().asSymbol())){
+      throw SemanticError("Error during evaluation: attempt to redefine a special-form");
+    }
+
+    if(frame.env->is_proc(tail[0].head())){
+      throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
+    }
+
+    frame.state = Frame::Define;
+    push(&tail[1], frame.env);
+    return false;
+  }
+
+  if(head.isLambda() && name == "lambda"){
+    // lambdas made in a local frame capture a snapshot of it as their scope,
+    // it never changes, so they share no mutable state with the frame
+    value = node->handle_lambda(frame.env == m_global ? nullptr :
+      std::make_shared<Environment>(frame.env->snapshot()));
+    return true;
+  }
+
+  if(head.isSymbol() && name == "if"){
+    if(tail.size() != 3){
+      throw SemanticError("Error during evaluation: invalid number of arguments to if");
+    }
+    frame.state = Frame::Branch;
+    push(&tail[0], frame.env);
+    return false;
+  }
+
+  // else attempt to treat as procedure
+  frame.state = Frame::Arguments;
+  frame.base = m_args.size();
+  frame.next = 1;
+  push(&tail[0], frame.env);
+  return false;
+}
+
+bool Evaluator::resume(Frame & frame, Expression & value){
+
+  const std::vector<Expression> & tail = frame.node->m_tail;
+
+  switch(frame.state){
+
+  case Frame::Arguments:
+    m_args.push_back(std::move(value));
+    if(frame.next < tail.size()){
+      push(&tail[frame.next++], frame.env);
+      return false;
+    }
+    return call(frame, value);
+
+  case Frame::Sequence:
+    // the last form of begin is in tail position
+    if(frame.next + 1 == tail.size()){
+      replace(frame, &tail[frame.next]);
+    }
+    else{
+      push(&tail[frame.next++], frame.env);
+    }
+    return false;
+
+  case Frame::Define:
+    if(frame.env->is_exp(frame.node->head())){
+      throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
+    }
+    if(frame.env != m_global && tail[1].head().isLambda() && tail[1].head().asSymbol() == "lambda"){
+      value = recursive(value, tail[0].head());
+    }
+    frame.env->add_exp(tail[0].head(), value);
+    return true;
+
+  case Frame::Branch:
+    if(!value.isHeadNumber()){
+      throw SemanticError("Error during evaluation: condition of if not a number");
+    }
+    replace(frame, (value.head().asNumber() != 0) ? &tail[1] : &tail[2]);
+    return false;
+
+  case Frame::Memoize:
+    // the arguments are still on the stack, they are the key
+    frame.memo->insert(Arguments(m_args.data() + frame.base, m_args.size() - frame.base), value);
+    m_args.resize(frame.base);
+    return true;
+
+  case Frame::Plot:
+    m_args.push_back(std::move(value));
+    if(frame.next < tail.size()){
+      push(&tail[frame.next++], frame.env);
+      return false;
+    }
+    {
+      Arguments args(m_args.data() + frame.base, m_args.size() - frame.base);
+      if(frame.node->head().asSymbol() == "discrete-plot"){
+        value = Expression::handle_dPlot(args[0], args[1]);
+      }
+      else if(frame.node->head().asSymbol() == "density-plot"){
+        value = Expression::handle_densityPlot(args[0], args[1]);
+      }
+      else{
+        // the samples are taken by evaluators of their own, on this thread
+        // or the pool, that count against this evaluation's budget
+        Environment local(frame.env);
+        local.budget = m_budget;
+        value = Expression::handle_cPlot(args[0], args[1], (args.size() == 3) ? &args[2] : nullptr, local);
+      }
+      m_args.resize(frame.base);
+    }
+    return true;
+
+  case Frame::ApplyList:
+    if(frame.next == 0){
+      nextProcedure(frame, std::move(value));
+      return false;
+    }
+    {
+      // a built-in procedure takes the list elements as its arguments as they are
+      Expression op = procedure(frame);
+      if(op.m_tail.empty() && value.isHeadList() && frame.env->is_proc(op.head())){
+        Expression list = std::move(value);
+        value = apply(op.head(), Arguments(list.m_tail), *frame.env);
+        return true;
+      }
+
+      std::vector<Expression> args;
+      args.push_back(op);
+      args.push_back(std::move(value));
+      replace(frame, applyOnList(args));
+    }
+    return false;
+
+  case Frame::MapList:
+    if(frame.next == 0){
+      nextProcedure(frame, std::move(value));
+      return false;
+    }
+    {
+      std::vector<Expression> args;
+      args.push_back(procedure(frame));
+      args.push_back(std::move(value));
+      replace(frame, map(args));
+    }
+    return false;
+
+  case Frame::ParallelMapList:
+    if(frame.next == 0){
+      nextProcedure(frame, std::move(value));
+      return false;
+    }
+    {
+      std::vector<Expression> args;
+      args.push_back(procedure(frame));
+      args.push_back(std::move(value));
+      Expression calls = map(args);
+
+      // without a pool (evaluation outside an Interpreter) this is map
+      ThreadPool * pool = ThreadPool::current();
+      if(pool == nullptr){
+        replace(frame, std::move(calls));
+        return false;
+      }
+      value = parallelMap(calls, *frame.env, m_budget, *pool);
+    }
+    return true;
+
+  default:
+    return true;
+  }
+}
+
+void Evaluator::startProcedure(Frame & frame){
+  const Expression & op = frame.node->m_tail[0];
+  // a symbol is resolved by each call, anything else is evaluated once first
+  if(op.m_tail.empty()){
+    frame.next = 1;
+    push(&frame.node->m_tail[1], frame.env);
+  }
+  else{
+    frame.next = 0;
+    push(&op, frame.env);
+  }
+}
+
+void Evaluator::nextProcedure(Frame & frame, Expression && value){
+  m_args.push_back(std::move(value));
+  frame.next = 1;
+  push(&frame.node->m_tail[1], frame.env);
+}
+
+Expression Evaluator::procedure(Frame & frame){
+  if(m_args.size() == frame.base){
+    return frame.node->m_tail[0];
+  }
+
+  // the calls name the evaluated lambda through a binding in a frame of their
+  // own, under a symbol no program can spell
+  Expression lambda = std::move(m_args[frame.base]);
+  m_args.resize(frame.base);
+  if(!lambda.isHeadLambda()){
+    throw SemanticError("Error: 1st argument to " + frame.node->head().asSymbol() + " not a procedure");
+  }
+  Atom name("(procedure)");
+  std::shared_ptr<Environment> local = std::make_shared<Environment>(frame.env);
+  local->add_exp(name, std::move(lambda));
+  frame.env = std::move(local);
+  return Expression(name);
+}
+
+std::shared_ptr<Environment> Evaluator::callFrame(const Closure & closure, Arguments args){
+
+  // bind the arguments in a fresh frame over the defining environment; the
+  // call belongs to this evaluation, whatever evaluation made the lambda
+  std::shared_ptr<Environment> local = std::make_shared<Environment>(scopeOf(closure, m_global));
+  local->cancel = m_global->cancel;
+  local->background = m_global->background;
+  local->budget = m_budget;
+  for(std::size_t i = 0; i < args.size(); ++i){
+    local->add_exp(closure.params[i], args[i]);
+  }
+  return local;
+}
+
+bool Evaluator::call(Frame & frame, Expression & value){
+
+  const Atom & op = frame.node->head();
+  const Expression * lambda = frame.env->find_exp(op);
+  Arguments args(m_args.data() + frame.base, m_args.size() - frame.base);
+
+  if(lambda == nullptr || !lambda->isHeadLambda()){
+    value = apply(op, args, *frame.env);
+    m_args.resize(frame.base);
+    return true;
+  }
+
+  std::shared_ptr<const Closure> closure = lambda->closure();
+  if(!closure){
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda function");
+  }
+  if(args.size() != closure->params.size()){
+    throw SemanticError("Error in call to function: invalid number of arguments.");
+  }
+
+  if(closure->memo && closure->memo->find(args, value)){
+    m_args.resize(frame.base);
+    return true;
+  }
+
+  std::shared_ptr<Environment> local = callFrame(*closure, args);
+
+  // a memoized body is not a tail call, this frame waits to store its value
+  if(closure->memo){
+    frame.state = Frame::Memoize;
+    frame.memo = closure->memo;
+    push(&closure->body, std::move(local));
+    m_stack.back().closure = std::move(closure);
+    return false;
+  }
+  m_args.resize(frame.base);
+
+  // the body is in tail position, so it takes over this frame
+  frame.env = std::move(local);
+  frame.closure = std::move(closure);
+  replace(frame, &frame.closure->body);
+  frame.owned.reset();
+  return false;
+}
@@ -0,0 +1,155 @@
+/*! \file evaluator.hpp
+Defines the Evaluator, which walks an AST using an explicit stack.
+ */
+#ifndef EVALUATOR_HPP
+#define EVALUATOR_HPP
+
+#include <memory>
+#include <vector>
+
+#include "cancel_token.hpp"
+#include "expression.hpp"
+
+// forward declare Environment
+class Environment;
+
+// forward declare Arguments
+class Arguments;
+
+/*! \class Evaluator
+\brief Evaluates an expression without recursing on the native stack.
+
+Pending work is kept as a stack of frames on the heap, one per expression
+node under evaluation. Calls in tail position (the last form of begin, the
+branches of if, and the body of a lambda) replace the current frame rather
+than pushing a new one, so tail-recursive procedures run in constant space.
+Calls to memoized lambdas are the exception, their frame stays to store the
+result once the body has been evaluated.
+
+Evaluated arguments are pushed on a single argument stack and procedures
+receive a view of their slice of it. The stacks keep their capacity between
+runs, so an Evaluator that is reused does not allocate for ordinary calls.
+
+The expression being evaluated is only read. Everything evaluation produces
+lives in the frames and on the argument stack, so one parsed program may be
+evaluated again, or by several Evaluators on different threads at once.
+ */
+class Evaluator {
+public:
+
+  /*! Evaluate an expression using a post-order traversal.
+    \param exp the expression to evaluate
+    \param env the environment to evaluate in, its cancel token is polled per node
+    \param limits the step budget and deadline of this evaluation, if unbounded
+    the evaluation counts against the budget of env, if any
+    \return the Expression resulting from the evaluation
+    \throws SemanticError when a semantic error is encountered, the token is
+    raised or a limit is exceeded
+   */
+  Expression run(const Expression & exp, Environment & env, const EvalLimits & limits = EvalLimits());
+
+  /*! Call a procedure on arguments that are already evaluated.
+    \param function a lambda value, or an expression whose head names a
+    built-in procedure
+    \param args the arguments of the call
+    \param env the environment of the caller, lambdas defined in it run over it
+    \param limits the step budget and deadline of the call, as for run
+    \return the result of the call
+    \throws SemanticError as run does, or if function is not a procedure or
+    is given the wrong number of arguments
+   */
+  Expression call(const Expression & function, Arguments args, Environment & env, const EvalLimits & limits = EvalLimits());
+
+private:
+
+  // a pending evaluation on the continuation stack
+  struct Frame {
+    // what the frame is waiting on when a child produces a value
+    enum State { Enter, Arguments, Sequence, Define, Branch, Plot, ApplyList, MapList, ParallelMapList, Memoize };
+
+    // the node being evaluated
+    const Expression * node;
+
+    // the environment the node is evaluated in
+    std::shared_ptr<Environment> env;
+
+    // storage for nodes built during evaluation (apply, map)
+    std::unique_ptr<Expression> owned;
+
+    // the closure whose body is being evaluated, kept alive for the call
+    std::shared_ptr<const Closure> closure;
+
+    // the cache to store the result of a memoized call in
+    std::shared_ptr<MemoCache> memo;
+
+    State state;
+
+    // index of the next tail expression to evaluate
+    std::size_t next;
+
+    // position of the first evaluated argument on the argument stack
+    std::size_t base;
+  };
+
+  // the continuation stack
+  std::vector<Frame> m_stack;
+
+  // the evaluated arguments of all pending procedure applications
+  std::vector<Expression> m_args;
+
+  // the environment evaluation started in, the scope of global lambdas
+  std::shared_ptr<Environment> m_global;
+
+  // the token of m_global, polled as each node is entered
+  const CancelToken * m_cancel = nullptr;
+
+  // the limits counted against, shared with the tasks this evaluation starts,
+  // empty for none
+  std::shared_ptr<EvalBudget> m_budget;
+
+  // nodes this evaluator entered, to read the clock every so often
+  std::size_t m_steps = 0;
+
+  // prepare to evaluate in env, the new global environment
+  void start(Environment & env, const EvalLimits & limits);
+
+  // run frames until the stack is empty, returning the last value
+  Expression loop();
+
+  // throw if the token is raised or a limit is exceeded
+  void poll();
+
+  // push a new frame evaluating node in env
+  void push(const Expression * node, std::shared_ptr<Environment> env);
+
+  // replace the top frame by one evaluating node (a tail call)
+  void replace(Frame & frame, const Expression * node);
+
+  // replace the top frame by one evaluating an expression it owns
+  void replace(Frame & frame, Expression && exp);
+
+  // start evaluating the node of the top frame
+  bool enter(Frame & frame, Expression & value);
+
+  // continue the top frame now that a child produced value
+  bool resume(Frame & frame, Expression & value);
+
+  // start an apply, map or parallel-map frame by evaluating its procedure,
+  // unless it is a symbol, then its list
+  void startProcedure(Frame & frame);
+
+  // keep the evaluated procedure on the argument stack, evaluate the list
+  void nextProcedure(Frame & frame, Expression && value);
+
+  // the procedure the calls of the frame name, binding an evaluated one in a
+  // new frame environment
+  Expression procedure(Frame & frame);
+
+  // a new frame binding the arguments of a call of closure
+  std::shared_ptr<Environment> callFrame(const Closure & closure, Arguments args);
+
+  // apply the procedure or lambda named by the frame head to its arguments
+  bool call(Frame & frame, Expression & value);
+};
+
+#endif
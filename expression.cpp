@@ -5,11 +5,19 @@
 #include <map>
 
 #include "environment.hpp"
+#include "evaluator.hpp"
+#include "graphics.hpp"
+#include "reduce.hpp"
 #include "semantic_error.hpp"
+#include "thread_pool.hpp"
 
 #include "parse.hpp"
 #include "interpreter.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
 #include <iostream>
 
 Expression::Expression(){}
@@ -23,10 +31,12 @@ Expression::Expression(const Atom & a){
 Expression::Expression(const Expression & a){
 
   m_head = a.m_head;
-  pList = a.pList;
-  for(auto e : a.m_tail){
-    m_tail.push_back(e);
-  }
+  m_properties = a.m_properties;
+  m_tail = a.m_tail;
+  m_closure = a.m_closure;
+  m_future = a.m_future;
+  m_packed = a.m_packed;
+  m_kind = a.m_kind;
 }
 
 Expression & Expression::operator=(const Expression & a){
@@ -34,16 +44,42 @@ Expression & Expression::operator=(const Expression & a){
   // prevent self-assignment
   if(this != &a){
     m_head = a.m_head;
-    m_tail.clear();
-    pList = a.pList;
-    for(auto e : a.m_tail){
-      m_tail.push_back(e);
-    } 
+    m_properties = a.m_properties;
+    m_tail = a.m_tail;
+    m_closure = a.m_closure;
+    m_future = a.m_future;
+    m_packed = a.m_packed;
+    m_kind = a.m_kind;
   }
   
   return *this;
 }
 
+Expression::Expression(Expression && a) noexcept:
+  m_head(std::move(a.m_head)),
+  m_tail(std::move(a.m_tail)),
+  m_closure(std::move(a.m_closure)),
+  m_future(std::move(a.m_future)),
+  m_packed(std::move(a.m_packed)),
+  m_properties(std::move(a.m_properties)),
+  m_kind(a.m_kind){
+}
+
+Expression & Expression::operator=(Expression && a) noexcept{
+
+  if(this != &a){
+    m_head = std::move(a.m_head);
+    m_properties = std::move(a.m_properties);
+    m_tail = std::move(a.m_tail);
+    m_closure = std::move(a.m_closure);
+    m_future = std::move(a.m_future);
+    m_packed = std::move(a.m_packed);
+    m_kind = a.m_kind;
+  }
+
+  return *this;
+}
+
 
 Atom & Expression::head(){
   return m_head;
@@ -73,34 +109,79 @@ bool Expression::isHeadLambda() const noexcept{
   return m_head.isLambda();
 }
 
+const std::shared_ptr<const Closure> & Expression::closure() const noexcept{
+  return m_closure;
+}
+
+Expression Expression::withClosure(std::shared_ptr<const Closure> closure) const{
+  Expression result(*this);
+  result.m_closure = std::move(closure);
+  return result;
+}
+
+const std::shared_ptr<const Future> & Expression::future() const noexcept{
+  return m_future;
+}
+
+Expression Expression::withFuture(std::shared_ptr<const Future> future) const{
+  Expression result(*this);
+  result.m_future = std::move(future);
+  return result;
+}
+
+const std::shared_ptr<const std::vector<double>> & Expression::packed() const noexcept{
+  return m_packed;
+}
+
+Expression Expression::withPacked(std::shared_ptr<const std::vector<double>> values) const{
+  Expression result(*this);
+  result.m_packed = std::move(values);
+  return result;
+}
+
+GraphicKind Expression::kind() const noexcept
+{
+  return m_kind;
+}
+
 bool Expression::isTypePoint() const noexcept
 {
-  auto name = pList.find("\"object-name\"");
-  if (name != pList.end()) {
-    if (name->second.head().asSymbol() == "\"point\"")
-        return true;
-  }
-  return false;
+  return m_kind == GraphicKind::Point;
 }
 
 bool Expression::isTypeLine() const noexcept
 {
-  auto name = pList.find("\"object-name\"");
-  if (name != pList.end()) {
-    if (name->second.head().asSymbol() == "\"line\"")
-      return true;
-  }
-  return false;
+  return m_kind == GraphicKind::Line;
 }
 
 bool Expression::isTypeText() const noexcept
 {
-  auto name = pList.find("\"object-name\"");
-  if (name != pList.end()) {
-    if (name->second.head().asSymbol() == "\"text\"")
-      return true;
-  }
-  return false;
+  return m_kind == GraphicKind::Text;
+}
+
+const std::map<std::string, Expression> & Expression::properties() const noexcept
+{
+  return m_properties;
+}
+
+void Expression::setProperty(const std::string & key, Expression value)
+{
+  if (key == "\"object-name\"") {
+    const std::string name = value.head().asSymbol();
+    if (name == "\"point\"")
+      m_kind = GraphicKind::Point;
+    else if (name == "\"line\"")
+      m_kind = GraphicKind::Line;
+    else if (name == "\"text\"")
+      m_kind = GraphicKind::Text;
+    else if (name == "\"polyline\"")
+      m_kind = GraphicKind::Polyline;
+    else if (name == "\"raster\"")
+      m_kind = GraphicKind::Raster;
+    else
+      m_kind = GraphicKind::None;
+  }
+  m_properties[key] = std::move(value);
 }
 
 //Expression Expression::getPointExpr()
@@ -135,6 +216,10 @@ void Expression::appendExpression(const Expression & a){
   m_tail.push_back(a);
 }
 
+void Expression::appendExpression(Expression && a){
+  m_tail.push_back(std::move(a));
+}
+
 Expression * Expression::tail(){
   Expression * ptr = nullptr;
   
@@ -153,26 +238,7 @@ Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
   return m_tail.cend();
 }
 
-Expression apply(const Atom & op, const std::vector<Expression> & args, const Environment & env){ 
-  
-  // head must be a symbol or a list
-  if(!op.isSymbol() && !op.isList()){
-    throw SemanticError("Error during evaluation: procedure name not symbol");
-  }
-  
-  // must map to a proc
-  if (!env.is_proc(op)) {
-    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda function");
-  }
-  
-  // map from symbol to proc
-  Procedure proc = env.get_proc(op);
-  
-  // call proc with args
-  return proc(args);
-}
-
-Expression Expression::handle_lookup(const Atom & head, const Environment & env){
+Expression Expression::handle_lookup(const Atom & head, const Environment & env) const{
     if(head.isSymbol()){ // if symbol is in env return value
       if(env.is_exp(head)){
 	      return env.get_exp(head);
@@ -184,7 +250,7 @@ Expression Expression::handle_lookup(const Atom & head, const Environment & env)
 	      throw SemanticError("Error during evaluation: unknown symbol");
       }
     }
-    else if(head.isNumber() || head.isList() || head.isLambda()){
+    else if(head.isNumber() || head.isComplexNumber() || head.isList() || head.isLambda()){
       return Expression(head);
     }
     else{
@@ -192,57 +258,7 @@ Expression Expression::handle_lookup(const Atom & head, const Environment & env)
     }
 }
 
-Expression Expression::handle_begin(Environment & env){
-  
-  if(m_tail.size() == 0){
-    throw SemanticError("Error during evaluation: zero arguments to begin");
-  }
-
-  // evaluate each arg from tail, return the last
-  Expression result;
-  for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-    result = it->eval(env);
-  }
-  
-  return result;
-}
-
-Expression Expression::handle_define(Environment & env){
-
-  // tail must have size 2 or error
-  if(m_tail.size() != 2){
-    throw SemanticError("Error during evaluation: invalid number of arguments to define");
-  }
-  
-  // tail[0] must be symbol
-  if(!m_tail[0].isHeadSymbol()){
-    throw SemanticError("Error during evaluation: first argument to define not symbol");
-  }
-
-  // but tail[0] must not be a special-form or procedure
-  std::string s = m_tail[0].head().asSymbol();
-  if((s == "define") || (s == "begin" || (s == "lambda"))){
-    throw SemanticError("Error during evaluation: attempt to redefine a special-form");
-  }
-
-  if(env.is_proc(m_head)){
-    throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
-  }
-  
-  // eval tail[1]
-  Expression result = m_tail[1].eval(env);
-
-  if(env.is_exp(m_head)){
-    throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
-  }
-
-  //and add to env
-  env.add_exp(m_tail[0].head(), result);
-  
-  return result;
-}
-
-Expression Expression::handle_lambda()
+Expression Expression::handle_lambda(const std::shared_ptr<Environment> & scope) const
 {
 
   // tail must have size 2 or error
@@ -258,36 +274,41 @@ Expression Expression::handle_lambda()
   if ((s == "define") || (s == "begin") || (s == "lambda")) {
     throw SemanticError("Error during evaluation: attempt to redefine a special-form");
   }
-  //if (env.is_proc(m_head)) {
-  //  throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
-  //}
-  // turn inputs into an expression of type list
-  std::vector<Expression> inputs;
-  Expression leftBranch = this->m_tail[0];
-  inputs.emplace_back(Expression(leftBranch.head()));
+
+  // prepare the closure: parameter slots and body
+  std::shared_ptr<Closure> closure = std::make_shared<Closure>();
+  const Expression & leftBranch = m_tail[0];
+  closure->params.push_back(leftBranch.head());
   for (auto e = leftBranch.tailConstBegin(); e != leftBranch.tailConstEnd(); ++e) {
     if (!(*e).isHeadSymbol()){
       throw SemanticError("Error during evaluation: input argument to lambda not symbol");
     }
-    inputs.emplace_back(*e);
+    closure->params.push_back(e->head());
+  }
+  closure->body = m_tail[1];
+  closure->scope = scope;
+  closure->owner = scope;
+
+  // the value keeps the inputs stored in a list kind for printing
+  Expression input(Atom("list"));
+  for (auto & p : closure->params) {
+    input.append(p);
   }
-  Expression input = list(inputs);
-  // update lambda expression to have input args stored in list kind
-  this->m_tail[0] = input;
-  Expression funcToStore(*this);
+  Expression funcToStore(m_head);
+  funcToStore.appendExpression(input);
+  funcToStore.appendExpression(closure->body);
+  funcToStore.m_closure = closure;
 
-  //std::map< std::string, Environment > localEnvs;
-  //Environment localEnv(env);
   return funcToStore;
 }
 
-void find_max_min(double & max, double & min, std::vector<double> & vec) {
+void find_max_min(double & max, double & min, const std::vector<double> & vec) {
   max = *max_element(std::begin(vec), std::end(vec));
   min = *min_element(std::begin(vec), std::end(vec));
 }
-void point_grabber(std::vector<double> & xpts, std::vector<double> & ypts, std::vector<Expression> & list) {
+void point_grabber(std::vector<double> & xpts, std::vector<double> & ypts, const std::vector<Expression> & list) {
 
-  for (auto exp : list) {
+  for (const auto & exp : list) {
     int i = 0;
     for (auto it = exp.tailConstBegin(); it < exp.tailConstEnd(); ++it) { ++i; }
     if (i != 2){ throw SemanticError("Error: bad point given in discrete plot"); }
@@ -303,8 +324,13 @@ void point_grabber(std::vector<double> & xpts, std::vector<double> & ypts, std::
     ypts.push_back(y);
   }
 }
-double M = 50.00;
-double ITERs = 10;
+double M = 50.00; // segments of the coarse continuous plot grid
+double ITERs = 10; // refinement passes
+double ANGLE = 175; // a continuous plot is refined where it bends sharper than this
+double MAXSAMPLES = 1000; // default continuous plot sample budget
+std::size_t SAMPLEGRAIN = 8; // fewest continuous plot samples worth a task
+double RESOLUTION = 64; // default density plot cells per side
+double MAXRESOLUTION = 1024; // a density plot grid holds at most this squared cells per worker
 double N = 20; //bounding box h/w
 double A = 3;
 double B = 3;
@@ -323,52 +349,149 @@ std::string to_pstr(const T a_value, const int n = 4) //TODO n = 2 dude.
   return out.str();
 }
 
-std::string boundingBoxCreator(std::vector<double> xpts, std::vector<double> ypts)
+// a coordinate as it reads back from to_pstr, plots keep their precision
+double rounded(double value, int n = 4)
+{
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.*g", n, value);
+  return std::strtod(text, nullptr);
+}
+
+// scaled coordinates that are not finite (data with no extent) cannot be drawn
+void check_finite(const std::vector<double> & pts, const std::string & name)
+{
+  for (double v : pts) {
+    if (!std::isfinite(v))
+      throw SemanticError("Error in call to " + name + ": data cannot be scaled to the plot.");
+  }
+}
+
+void boundingBoxCreator(Expression & plot, const std::vector<double> & xpts, const std::vector<double> & ypts)
 {
-  using namespace std;
   double pymax, pymin, pxmax, pxmin; //pseudo "relative".. also y is negativeized
   find_max_min(pxmax, pxmin, xpts);
   find_max_min(pymax, pymin, ypts);
-  string tlp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(pymax) + ") "; //top left point
-  string trp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(pymax) + ") ";
-  string blp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(pymin) + ") ";
-  string brp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(pymin) + ") ";
-  string boxLines = "(set-property \"thickness\" 0 (make-line " + tlp + trp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + trp + brp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + blp + brp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + tlp + blp + ")) ";
-  return boxLines;
-}
-
-std::string tickPointNumberGenerator(double pxmax,double pymax, double pxmin, double  pymin, double  xmax, double ymax, double xmin, double ymin)
+  Expression tlp = makePoint(rounded(pxmin), rounded(pymax)); //top left point
+  Expression trp = makePoint(rounded(pxmax), rounded(pymax));
+  Expression blp = makePoint(rounded(pxmin), rounded(pymin));
+  Expression brp = makePoint(rounded(pxmax), rounded(pymin));
+  plot.appendExpression(makeLine(tlp, trp, 0));
+  plot.appendExpression(makeLine(trp, brp, 0));
+  plot.appendExpression(makeLine(blp, brp, 0));
+  plot.appendExpression(makeLine(tlp, blp, 0));
+}
+
+// the x axis where it crosses the bounding box, then the y axis
+void axisLineCreator(Expression & plot, double pxmax, double pymax, double pxmin, double pymin, double xmax, double ymax, double xmin, double ymin)
 {
-  std::string axisNums = "(set-property \"position\" (make-point " + to_pstr(pxmin - D) + " " + to_pstr(pymin) + ") " + "(make-text \"" + to_pstr(ymax, 2) + "\") ) ";
-  axisNums += "(set-property \"position\" (make-point " + to_pstr(pxmin - D) + " " + to_pstr(pymax) + ") " + "(make-text \"" + to_pstr(ymin, 2) + "\") ) ";
-  axisNums += "(set-property \"position\" (make-point " + to_pstr(pxmin) + " " + to_pstr(pymax + C) + ") " + "(make-text \"" + to_pstr(xmin, 2) + "\") ) ";
-  axisNums += "(set-property \"position\" (make-point " + to_pstr(pxmax) + " " + to_pstr(pymax + C) + ") " + "(make-text \"" + to_pstr(xmax, 2) + "\") ) ";
-  return axisNums;
+  if (ymax >= 0 && ymin <= 0) {
+    Expression lp = makePoint(rounded(pxmin), 0);
+    Expression rp = makePoint(rounded(pxmax), 0);
+    plot.appendExpression(makeLine(rp, lp, 0));
+  }
+  if (xmax >= 0 && xmin <= 0) {
+    Expression tp = makePoint(0, rounded(pymin));
+    Expression bp = makePoint(0, rounded(pymax));
+    plot.appendExpression(makeLine(tp, bp, 0));
+  }
+}
+
+Atom tickLabel(double value)
+{
+  return Atom("\"" + to_pstr(value, 2) + "\"");
+}
+
+void tickPointNumberGenerator(Expression & plot, double pxmax,double pymax, double pxmin, double  pymin, double  xmax, double ymax, double xmin, double ymin)
+{
+  plot.appendExpression(makeText(tickLabel(ymax), makePoint(rounded(pxmin - D), rounded(pymin))));
+  plot.appendExpression(makeText(tickLabel(ymin), makePoint(rounded(pxmin - D), rounded(pymax))));
+  plot.appendExpression(makeText(tickLabel(xmin), makePoint(rounded(pxmin), rounded(pymax + C))));
+  plot.appendExpression(makeText(tickLabel(xmax), makePoint(rounded(pxmax), rounded(pymax + C))));
 }
 
-Expression Expression::handle_dPlot(Environment & env) 
+// the value of the count option key, an integer from 2 to most, or fallback
+std::size_t countOption(const Expression * opts, const std::string & key, double fallback, const std::string & name, double most = HUGE_VAL)
+{
+  double count = fallback;
+  if (opts != nullptr) {
+    for (auto o = opts->tailConstBegin(); o != opts->tailConstEnd(); ++o) {
+      if (o->tailConstEnd() - o->tailConstBegin() == 2 && o->tailConstBegin()->head().asSymbol() == "\"" + key + "\"") {
+        count = (o->tailConstBegin() + 1)->head().isNumber() ? (o->tailConstBegin() + 1)->head().asNumber() : 0;
+        if (count < 2 || count != std::floor(count))
+          throw SemanticError("Error in call to " + name + ": " + key + " not an integer of at least 2.");
+        if (count > most)
+          throw SemanticError("Error in call to " + name + ": " + key + " greater than " + to_pstr(most, 10) + ".");
+      }
+    }
+  }
+  return static_cast<std::size_t>(count);
+}
+
+// Largest triangle three buckets: the indices of at most target points that
+// keep the shape of the series, in order of x. The first and last points are
+// kept, the rest are cut into target - 2 buckets and from each the point
+// making the largest triangle with the one kept before it and the average of
+// the next bucket is kept.
+std::vector<std::size_t> decimate(const std::vector<double> & xpts, const std::vector<double> & ypts, std::size_t target)
+{
+  std::vector<std::size_t> order(xpts.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&xpts](std::size_t a, std::size_t b) { return xpts[a] < xpts[b]; });
+
+  const std::size_t n = order.size();
+  std::vector<std::size_t> kept;
+  kept.reserve(target);
+  kept.push_back(order.front());
+
+  const double every = double(n - 2) / double(target - 2);
+  std::size_t a = order.front();
+  for (std::size_t b = 0; b + 2 < target; ++b) {
+    std::size_t first = std::size_t(b * every) + 1;
+    std::size_t last = std::min(std::size_t((b + 1) * every) + 1, n - 1);
+
+    // the average of the next bucket, or the last point after the final one
+    std::size_t nextFirst = last;
+    std::size_t nextLast = std::max(std::min(std::size_t((b + 2) * every) + 1, n - 1), nextFirst + 1);
+    double avgx = 0, avgy = 0;
+    for (std::size_t i = nextFirst; i < nextLast; ++i) {
+      avgx += xpts[order[i]];
+      avgy += ypts[order[i]];
+    }
+    avgx /= (nextLast - nextFirst);
+    avgy /= (nextLast - nextFirst);
+
+    double largest = -1;
+    std::size_t chosen = order[first];
+    for (std::size_t i = first; i < last; ++i) {
+      std::size_t p = order[i];
+      double area = std::fabs((xpts[a] - avgx) * (ypts[p] - ypts[a]) - (xpts[a] - xpts[p]) * (avgy - ypts[a]));
+      if (area > largest) {
+        largest = area;
+        chosen = p;
+      }
+    }
+    kept.push_back(chosen);
+    a = chosen;
+  }
+
+  kept.push_back(order.back());
+  return kept;
+}
+
+Expression Expression::handle_dPlot(const Expression & data, const Expression & opts)
 {
   using namespace std;
   double ymax, ymin, xmax, xmin; 
   double pymax, pymin, pxmax, pxmin; //pseudo "relative".. also y is negativeized
   std::vector<double> xpts;
   std::vector<double> ypts;
-  vector<string> lollipopPtsVec;
-  Expression discretePlotList;
-  string list = "( list ";
-  string pointList = " ";
-  string axisNums = " ";
-  string axisLines = " ";
-  string lollipopLines = " ";
-  string options = " ";
+  Expression plot(Atom("list"));
   enum X_axis_pos { below, inside, above };
   X_axis_pos x_axis_pos = inside;
   
   //add points
-  point_grabber(xpts, ypts, m_tail[0].m_tail);
+  point_grabber(xpts, ypts, data.m_tail);
   find_max_min(xmax, xmin, xpts);
   find_max_min(ymax, ymin, ypts);
   for (size_t m = 0; m < xpts.size(); ++m) {
@@ -377,442 +500,384 @@ Expression Expression::handle_dPlot(Environment & env)
   for (size_t m = 0; m < ypts.size(); ++m) {
     ypts[m] *= -N / (ymax - ymin);
   }
-  for (size_t i = 0; i < xpts.size(); ++i) {
-    lollipopPtsVec.push_back("(set-property \"size\" " + to_pstr(P) + " (make-point " + to_pstr(xpts[i]) + " " + to_pstr(ypts[i]) + " )) ");
-    pointList += "(set-property \"size\" " + to_pstr(P) + " (make-point " + to_pstr(xpts[i]) + " " + to_pstr(ypts[i]) + " )) ";
+  check_finite(xpts, "discrete-plot");
+  check_finite(ypts, "discrete-plot");
+
+  // past max-points the series is decimated, the box still spans all of it
+  const std::size_t target = countOption(&opts, "max-points", 0, "discrete-plot");
+  std::vector<std::size_t> drawn;
+  if (target != 0 && xpts.size() > target) {
+    drawn = decimate(xpts, ypts, target);
+  }
+  else {
+    for (size_t i = 0; i < xpts.size(); ++i)
+      drawn.push_back(i);
+  }
+
+  // each point is drawn twice, as a point and at the top of its stem
+  std::vector<double> rxpts(drawn.size());
+  std::vector<double> rypts(drawn.size());
+  const double size = rounded(P);
+  for (size_t i = 0; i < drawn.size(); ++i) {
+    rxpts[i] = rounded(xpts[drawn[i]]);
+    rypts[i] = rounded(ypts[drawn[i]]);
+    plot.appendExpression(makePoint(rxpts[i], rypts[i], size));
   }
-  list += pointList;
 
   find_max_min(pxmax, pxmin, xpts);
   find_max_min(pymax, pymin, ypts);
   
   //add bounding box
-  list += boundingBoxCreator(xpts, ypts);
+  boundingBoxCreator(plot, xpts, ypts);
 
-  //cout << "\n pymax: " << pymax << " \t pymin: " << pymin << "\t diff " << pymin-pymax;
-  //cout << "\n pxmax: " << pxmax << " \t pxmin: " << pxmin << "\t diff " << pxmin-pxmax;
-  
   //add axies
-  if (ymax >= 0 && ymin <= 0){
-    string lp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(0) + ") ";
-    string rp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(0) + ") ";
-    axisLines += "(set-property \"thickness\" 0 ( make-line " + rp + lp + " )) ";
-  }
-  else if (ymax < 0) { x_axis_pos = above; }
+  axisLineCreator(plot, pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
+  if (ymax < 0) { x_axis_pos = above; }
   else if (ymin > 0) { x_axis_pos = below; }
-  //cout << "\n ymax: " << ymax << " \t ymin: " << ymin << "\n";
-  if (xmax >= 0 && xmin <= 0){
-    string tp = "(make-point " + to_pstr(0) + " " + to_pstr(pymin) + ") ";
-    string bp = "(make-point " + to_pstr(0) + " " + to_pstr(pymax) + ") ";
-    axisLines += "(set-property \"thickness\" 0 ( make-line " + tp + bp + " ))  ";
-  }
-  list += axisLines; 
 
   //make lollipops
-  for (size_t i = 0; i < xpts.size(); ++i)
+  double base = 0;
+  if (x_axis_pos == above) {
+    base = rounded(pymin);
+  }
+  else if (x_axis_pos == below) {
+    base = rounded(pymax);
+  }
+  for (size_t i = 0; i < drawn.size(); ++i)
   {
-    string point2 = " ";
-    if (x_axis_pos == inside){
-      point2 = "(make-point " + to_pstr(xpts[i]) + " " + to_pstr(0) + " )";
-    }
-    else if (x_axis_pos == above) {
-      point2 = "(make-point " + to_pstr(xpts[i]) + " " + to_pstr(pymin) + " )";
-    }
-    else if (x_axis_pos == below) {
-      point2 = "(make-point " + to_pstr(xpts[i]) + " " + to_pstr(pymax) + " )";
-    }
-    lollipopLines += "(set-property \"thickness\" 0 ( make-line " + lollipopPtsVec[i] + " " + point2 + " )) ";
+    plot.appendExpression(makeLine(makePoint(rxpts[i], rypts[i], size), makePoint(rxpts[i], base), 0));
+  }
+
+  //the ordinate label reads bottom to top
+  optionsGenerator(plot, opts, "discrete-plot", 270 * (std::atan2(0, -1) / 180), pxmax, pymax, pxmin, pymin);
+
+  //add tick point numbers
+  tickPointNumberGenerator(plot, pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
+
+  return plot;
+}
+
+// the extent of some density plot points
+struct Extent {
+  double xmin, xmax, ymin, ymax;
+};
+
+// the x and y of a density plot point, which must be a list of two numbers
+std::pair<double, double> densityPoint(const Expression & point)
+{
+  if (point.tailConstEnd() - point.tailConstBegin() != 2 ||
+      !point.tailConstBegin()->isHeadNumber() || !(point.tailConstBegin() + 1)->isHeadNumber())
+    throw SemanticError("Error: bad point given in density plot");
+  return std::make_pair(point.tailConstBegin()->head().asNumber(), (point.tailConstBegin() + 1)->head().asNumber());
+}
+
+Extent densityExtent(Arguments points)
+{
+  std::pair<double, double> first = densityPoint(points[0]);
+  Extent extent = {first.first, first.first, first.second, first.second};
+  for (auto & p : points) {
+    std::pair<double, double> xy = densityPoint(p);
+    extent.xmin = std::min(extent.xmin, xy.first);
+    extent.xmax = std::max(extent.xmax, xy.first);
+    extent.ymin = std::min(extent.ymin, xy.second);
+    extent.ymax = std::max(extent.ymax, xy.second);
   }
-  list += lollipopLines;
+  return extent;
+}
 
+Extent densityExtentCombine(const Extent & left, const Extent & right)
+{
+  Extent extent = {std::min(left.xmin, right.xmin), std::max(left.xmax, right.xmax),
+                   std::min(left.ymin, right.ymin), std::max(left.ymax, right.ymax)};
+  return extent;
+}
+
+Expression Expression::handle_densityPlot(const Expression & data, const Expression & opts)
+{
+  if (!data.isHeadList() || data.m_tail.empty())
+    throw SemanticError("Error in call to density-plot: data not a list of points.");
+  const std::size_t resolution = countOption(&opts, "resolution", RESOLUTION, "density-plot", MAXRESOLUTION);
+
+  // the extent in chunks, then the counts into one grid per worker
+  Arguments points(data.m_tail.data(), data.m_tail.size());
+  const Extent e = reduce<Extent>(points, densityExtent, densityExtentCombine);
+  if (!(e.xmax > e.xmin) || !(e.ymax > e.ymin) || !std::isfinite(e.xmax - e.xmin) || !std::isfinite(e.ymax - e.ymin))
+    throw SemanticError("Error in call to density-plot: data cannot be scaled to the plot.");
+
+  typedef std::vector<double> Cells;
+  Cells cells = accumulate(points, Cells(resolution * resolution, 0),
+    [&e, resolution](Cells & grid, Arguments chunk) {
+      for (auto & p : chunk) {
+        std::pair<double, double> xy = densityPoint(p);
+        std::size_t column = std::min(std::size_t((xy.first - e.xmin) / (e.xmax - e.xmin) * resolution), resolution - 1);
+        std::size_t row = std::min(std::size_t((xy.second - e.ymin) / (e.ymax - e.ymin) * resolution), resolution - 1);
+        // the first row is drawn at the top
+        grid[(resolution - 1 - row) * resolution + column] += 1;
+      }
+    },
+    [](Cells & into, const Cells & from) {
+      for (std::size_t i = 0; i < into.size(); ++i)
+        into[i] += from[i];
+    });
+
+  // scaled like discrete-plot, y is negated
+  const double pxmin = e.xmin * N / (e.xmax - e.xmin), pxmax = e.xmax * N / (e.xmax - e.xmin);
+  const double pymin = -e.ymax * N / (e.ymax - e.ymin), pymax = -e.ymin * N / (e.ymax - e.ymin);
+
+  Expression plot(Atom("list"));
+  plot.appendExpression(makeRaster(std::move(cells), resolution, makePoint(rounded(pxmin), rounded(pymin)),
+                                   rounded(pxmax) - rounded(pxmin), rounded(pymax) - rounded(pymin)));
+  boundingBoxCreator(plot, {pxmin, pxmax}, {pymin, pymax});
+  axisLineCreator(plot, pxmax, pymax, pxmin, pymin, e.xmax, e.ymax, e.xmin, e.ymin);
+  optionsGenerator(plot, opts, "density-plot", 270 * (std::atan2(0, -1) / 180), pxmax, pymax, pxmin, pymin);
+  tickPointNumberGenerator(plot, pxmax, pymax, pxmin, pymin, e.xmax, e.ymax, e.xmin, e.ymin);
+  return plot;
+}
+
+void Expression::optionsGenerator(Expression & plot, const Expression & opts, const std::string & name, double rotation, double pxmax, double pymax, double pxmin, double pymin)
+{
   //(list
   //(list "title" "The Data")
   //(list "abscissa-label" "X Label")
   //(list "ordinate-label" "Y Label")
   //(list "text-scale" 1))))
   double scale = 1;
-  for (size_t i = 0; i < m_tail[1].m_tail.size(); ++i) {
-    if (m_tail[1].m_tail[i].m_tail.size() != 2) {
-      throw SemanticError("Error in call to discrete-plot: bad OPTIONS parameter.");
+  for (size_t i = 0; i < opts.m_tail.size(); ++i) {
+    if (opts.m_tail[i].m_tail.size() != 2) {
+      throw SemanticError("Error in call to " + name + ": bad OPTIONS parameter.");
     }
-    if (m_tail[1].m_tail[i].m_tail[0].head().asSymbol() == "\"text-scale\"") {
-      scale = m_tail[1].m_tail[i].m_tail[1].head().asNumber();
+    if (opts.m_tail[i].m_tail[0].head().asSymbol() == "\"text-scale\"") {
+      scale = opts.m_tail[i].m_tail[1].head().asNumber();
     }
   }
-  for (size_t i = 0; i < m_tail[1].m_tail.size(); ++i) {
-    if (m_tail[1].m_tail[i].m_tail.size() != 2) {
-      throw SemanticError("Error in call to discrete-plot: bad OPTIONS parameter.");
+  for (size_t i = 0; i < opts.m_tail.size(); ++i) {
+    const std::string key = opts.m_tail[i].m_tail[0].head().asSymbol();
+    const Atom & label = opts.m_tail[i].m_tail[1].head();
+    Expression pos;
+    if (key == "\"title\"") {
+      pos = makePoint(rounded(pxmin + (pxmax - pxmin) / 2.0), rounded(pymin - A));
     }
-    if (m_tail[1].m_tail[i].m_tail[0].head().asSymbol() == "\"title\"") {
-      string pos = " (make-point " + to_pstr(pxmin+(pxmax-pxmin)/2.0) + " " + to_pstr(pymin - A) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += "(set-property \"position\" " + pos + "(make-text " + m_tail[1].m_tail[i].m_tail[1].head().asSymbol() + ") ) )";
+    else if (key == "\"abscissa-label\"") {
+      pos = makePoint(rounded(pxmin + (pxmax - pxmin) / 2.0), rounded(pymax + A));
     }
-    else if (m_tail[1].m_tail[i].m_tail[0].head().asSymbol() == "\"abscissa-label\"") {
-      string pos = " (make-point " + to_pstr(pxmin + (pxmax - pxmin) / 2.0) + " " + to_pstr(pymax + A) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += "(set-property \"position\" " + pos + "(make-text " + m_tail[1].m_tail[i].m_tail[1].head().asSymbol() + ") ) )";
+    else if (key == "\"ordinate-label\"") {
+      pos = makePoint(rounded(pxmin - B), rounded(pymax - (pymax - pymin) / 2.0));
     }
-    else if (m_tail[1].m_tail[i].m_tail[0].head().asSymbol() == "\"ordinate-label\"") {
-      string rotation = "(set-property \"text-rotation\" (* 270 (/ pi 180 )) ";
-      string pos = " (make-point " + to_pstr(pxmin - B) + " " + to_pstr(pymax-(pymax-pymin)/2.0) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += rotation + "(set-property \"position\" " + pos + "(make-text " + m_tail[1].m_tail[i].m_tail[1].head().asSymbol() + ") ) ) )";
+    else {
+      continue;
     }
-  }
-  //cout << options;
-  list += options;
-
-  //add tick point numbers
-  list += tickPointNumberGenerator(pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
-    
-  list += " )";
-  /*cout << list;*/
-  std::istringstream iss(list);
-  TokenSequenceType tokens = tokenize(iss);
-  auto ast = parse(tokens);
-  if (ast == Expression())
-    std::cerr << "Error: bad discrete plot input." << std::endl;
-  else {
-    try {
-      discretePlotList = ast.eval(env);
+    if (label.asSymbol().empty() || label.asSymbol()[0] != '"') {
+      throw SemanticError("Error in call to " + name + ": bad OPTIONS parameter.");
     }
-    catch (const SemanticError & ex) {
-      std::cerr << ex.what() << std::endl;
+
+    Expression text = makeText(label, pos);
+    text.setProperty("\"text-scale\"", Expression(rounded(scale)));
+    if (key == "\"ordinate-label\"") {
+      text.setProperty("\"text-rotation\"", Expression(rotation));
     }
+    plot.appendExpression(text);
   }
-  return discretePlotList;
 }
 
-std::string boundingBoxCreatorCont(std::vector<double> xpts, std::vector<double> ypts)
+// the function at xs[first, last) into ys, through one evaluator
+void sampleRange(const Expression & function, const std::vector<double> & xs, std::size_t first, std::size_t last, std::vector<double> & ys, Environment & env)
 {
-  using namespace std;
-  double pymax, pymin, pxmax, pxmin; //pseudo "relative".. also y is negativeized
-  find_max_min(pxmax, pxmin, xpts);
-  find_max_min(pymax, pymin, ypts);
-  string tlp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(pymax) + ") "; //top left point
-  string trp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(pymax) + ") ";
-  string blp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(pymin) + ") ";
-  string brp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(pymin) + ") ";
-  string boxLines = "(set-property \"thickness\" 0 (make-line " + tlp + trp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + trp + brp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + blp + brp + ")) ";
-  boxLines += "(set-property \"thickness\" 0 (make-line " + tlp + blp + ")) ";
-  return boxLines;
-}
-
-std::string Expression::optionsGenerator(double pxmax, double pymax, double pxmin, double pymin, int tailpos)
+  Evaluator evaluator;
+  Expression arg;
+  for (std::size_t i = first; i < last; ++i) {
+    if (env.cancel != nullptr && env.cancel->cancelled())
+      throw SemanticError("Error: interpreter kernel interrupted");
+    arg = Expression(xs[i]);
+    Expression y = evaluator.call(function, Arguments(&arg, 1), env);
+    if (!y.isHeadNumber())
+      throw SemanticError("Error in call to continuous-plot: function value not a number.");
+    ys[i] = y.head().asNumber();
+  }
+}
+
+// The function at each x, which must be a number. With a current pool of
+// more than one worker the xs are cut into contiguous runs, one task each,
+// and every task evaluates in its own frame over a snapshot of env, so the
+// samples come back in order and nothing a task defines is seen by another.
+std::vector<double> sampleFunction(const Expression & function, const std::vector<double> & xs, Environment & env)
 {
-  //(list
-  //(list "title" "The Data")
-  //(list "abscissa-label" "X Label")
-  //(list "ordinate-label" "Y Label")
-  //(list "text-scale" 1))))
-  using namespace std;
-  string options = " ";
-  double scale = 1;
-  for (size_t i = 0; i < m_tail[tailpos].m_tail.size(); ++i) {
-    if (m_tail[tailpos].m_tail[i].m_tail.size() != 2) {
-      throw SemanticError("Error in call to plot: bad OPTIONS parameter.");
-    }
-    if (m_tail[tailpos].m_tail[i].m_tail[0].head().asSymbol() == "\"text-scale\"") {
-      scale = m_tail[tailpos].m_tail[i].m_tail[1].head().asNumber();
-    }
+  std::vector<double> ys(xs.size());
+
+  ThreadPool * pool = ThreadPool::current();
+  const std::size_t tasks = (pool == nullptr) ? 1 : std::min(pool->size(), xs.size() / SAMPLEGRAIN);
+  if (tasks <= 1) {
+    sampleRange(function, xs, 0, xs.size(), ys, env);
+    return ys;
   }
-  for (size_t i = 0; i < m_tail[tailpos].m_tail.size(); ++i) {
-    if (m_tail[tailpos].m_tail[i].m_tail.size() != 2) {
-      throw SemanticError("Error in call to plot: bad OPTIONS parameter.");
-    }
-    if (m_tail[tailpos].m_tail[i].m_tail[0].head().asSymbol() == "\"title\"") {
-      string pos = " (make-point " + to_pstr(pxmin + (pxmax - pxmin) / 2.0) + " " + to_pstr(pymin - A) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += "(set-property \"position\" " + pos + "(make-text " + m_tail[tailpos].m_tail[i].m_tail[1].head().asSymbol() + ") ) )";
-      //cout << "\n AHHHHHHHHHHHHHHHHHHHH: " << pos << endl;
+
+  std::shared_ptr<Environment> snapshot = std::make_shared<Environment>(env.snapshot());
+  std::vector<std::future<void>> done;
+  for (std::size_t t = 0; t < tasks; ++t) {
+    std::size_t first = xs.size() * t / tasks;
+    std::size_t last = xs.size() * (t + 1) / tasks;
+    done.push_back(pool->submit([&function, &xs, &ys, snapshot, first, last]() {
+      Environment local(snapshot);
+      sampleRange(function, xs, first, last, ys, local);
+    }, env.cancel));
+  }
+
+  // let every task finish before an error leaves this frame
+  std::exception_ptr error;
+  for (auto & d : done) {
+    try {
+      pool->wait(d);
     }
-    else if (m_tail[tailpos].m_tail[i].m_tail[0].head().asSymbol() == "\"abscissa-label\"") {
-      string pos = " (make-point " + to_pstr(pxmin + (pxmax - pxmin) / 2.0) + " " + to_pstr(pymax + A) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += "(set-property \"position\" " + pos + "(make-text " + m_tail[tailpos].m_tail[i].m_tail[1].head().asSymbol() + ") ) )";
+    catch (...) {
+      if (!error)
+        error = std::current_exception();
     }
-    else if (m_tail[tailpos].m_tail[i].m_tail[0].head().asSymbol() == "\"ordinate-label\"") {
-      string rotation;
-      if (tailpos == 1)
-        rotation = "(set-property \"text-rotation\" (* 270 (/ pi 180 )) ";
-      if (tailpos == 2)
-        rotation = "(set-property \"text-rotation\" (0) ";
-      string pos = " (make-point " + to_pstr(pxmin - B) + " " + to_pstr(pymax - (pymax - pymin) / 2.0) + " )";
-      options += "( set-property \"text-scale\" " + to_pstr(scale) + " ";
-      options += rotation + "(set-property \"position\" " + pos + "(make-text " + m_tail[tailpos].m_tail[i].m_tail[1].head().asSymbol() + ") ) ) )";
+  }
+  if (error)
+    std::rethrow_exception(error);
+  return ys;
+}
+
+// how far, in degrees, the path a b c turns at b, 0 for a straight line
+double turnAngle(double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double ux = ax - bx, uy = ay - by;
+  double vx = cx - bx, vy = cy - by;
+  double lengths = std::sqrt((ux * ux + uy * uy) * (vx * vx + vy * vy));
+  if (!(lengths > 0))
+    return 0;
+  double cosine = std::max(-1.0, std::min(1.0, (ux * vx + uy * vy) / lengths));
+  return 180 - std::acos(cosine) * 180 / std::atan2(0, -1);
+}
+
+// Split the segments on either side of a sample where the curve, as drawn,
+// turns by more than 180 - ANGLE degrees, for up to ITERs passes. Sharper
+// turns are split first when the budget does not cover them all, so smooth
+// stretches keep the coarse grid and corners are sampled densely.
+void refineSamples(const Expression & function, std::vector<double> & xpts, std::vector<double> & ypts, std::size_t budget, Environment & env)
+{
+  for (int pass = 0; pass < ITERs && xpts.size() < budget && xpts.size() > 2; ++pass) {
+    double xmax, xmin, ymax, ymin;
+    find_max_min(xmax, xmin, xpts);
+    find_max_min(ymax, ymin, ypts);
+    const double sx = (xmax > xmin) ? N / (xmax - xmin) : 1;
+    const double sy = (ymax > ymin) ? N / (ymax - ymin) : 1;
+
+    std::vector<double> turn(xpts.size(), 0);
+    for (std::size_t i = 1; i + 1 < xpts.size(); ++i) {
+      turn[i] = turnAngle(xpts[i - 1] * sx, ypts[i - 1] * sy, xpts[i] * sx, ypts[i] * sy, xpts[i + 1] * sx, ypts[i + 1] * sy);
+    }
+
+    // segments to split, sharpest first, by position among equals
+    std::vector<std::pair<double, std::size_t>> sharp;
+    for (std::size_t i = 0; i + 1 < xpts.size(); ++i) {
+      double t = std::max(turn[i], turn[i + 1]);
+      if (t > 180 - ANGLE)
+        sharp.push_back(std::make_pair(t, i));
+    }
+    if (sharp.empty())
+      break;
+    std::sort(sharp.begin(), sharp.end(), [](const std::pair<double, std::size_t> & a, const std::pair<double, std::size_t> & b) {
+      return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+    });
+    if (sharp.size() > budget - xpts.size())
+      sharp.resize(budget - xpts.size());
+
+    std::vector<bool> split(xpts.size() - 1, false);
+    for (auto & s : sharp)
+      split[s.second] = true;
+
+    std::vector<double> mids;
+    for (std::size_t i = 0; i + 1 < xpts.size(); ++i) {
+      if (split[i])
+        mids.push_back(xpts[i] + (xpts[i + 1] - xpts[i]) / 2);
+    }
+    std::vector<double> midys = sampleFunction(function, mids, env);
+
+    std::vector<double> xs, ys;
+    xs.reserve(xpts.size() + mids.size());
+    ys.reserve(xpts.size() + mids.size());
+    for (std::size_t i = 0, m = 0; i < xpts.size(); ++i) {
+      xs.push_back(xpts[i]);
+      ys.push_back(ypts[i]);
+      if (i < split.size() && split[i]) {
+        xs.push_back(mids[m]);
+        ys.push_back(midys[m]);
+        ++m;
+      }
     }
+    xpts.swap(xs);
+    ypts.swap(ys);
   }
-  return options;
 }
 
-Expression Expression::handle_cPlot(Environment & env)
+Expression Expression::handle_cPlot(const Expression & function, const Expression & bounds, const Expression * opts, Environment & env)
 {
   using namespace std;
-  //m_tail[0]; //lambda function
-  //m_tail[1]; //range
-  //enum X_axis_pos { below, inside, above };
-  //X_axis_pos x_axis_pos = inside;
+  //function; //lambda function
+  //bounds; //range
   double ymax, ymin, xmax, xmin;
   double pymax, pymin, pxmax, pxmin; //pseudo "relative".. also y is negativeized
   std::vector<double> xpts;
   std::vector<double> ypts;
-  Expression continuousPlotList;
-  string list = "( list ";
-  string pointList = " ";
-  string axisLines = " ";
-
-  auto exp = m_tail[1];
-  if (!exp.tailConstBegin()->head().isNumber())
-    throw SemanticError("Error: bad point given in contin plot");
-  if (!(exp.tailConstEnd() - 1)->head().isNumber())
-    throw SemanticError("Error: bad point given in contin plot");
+  Expression plot(Atom("list"));
+
+  if (!function.isHeadLambda() && !env.is_proc(function.head()))
+    throw SemanticError("Error in call to continuous-plot: first argument not a procedure.");
+
+  const Expression & exp = bounds;
+  if (!exp.isHeadList() || exp.tailConstEnd() - exp.tailConstBegin() != 2)
+    throw SemanticError("Error in call to continuous-plot: bounds not a list of two numbers.");
+  if (!exp.tailConstBegin()->isHeadNumber() || !(exp.tailConstBegin() + 1)->isHeadNumber())
+    throw SemanticError("Error in call to continuous-plot: bounds not a list of two numbers.");
   xmin = exp.tailConstBegin()->head().asNumber();
-  xmax = (exp.tailConstEnd() - 1)->head().asNumber();
+  xmax = (exp.tailConstBegin() + 1)->head().asNumber();
+  if (xmin == xmax)
+    throw SemanticError("Error in call to continuous-plot: empty bounds.");
 
-  double stepSize = (xmax - xmin) / M;
-  //cout << stepSize << endl << endl;
-  for (double i = xmin; i <= xmax + stepSize; i += stepSize) {
-    //cout << i << endl;
-    xpts.push_back(i);
+  // a coarse grid, refined where the curve bends
+  const std::size_t budget = countOption(opts, "max-samples", MAXSAMPLES, "continuous-plot");
+  const std::size_t segments = std::min<std::size_t>(M, budget - 1);
+  for (std::size_t k = 0; k <= segments; ++k) {
+    xpts.push_back(xmin + (xmax - xmin) * k / segments);
   }
-  //if (xpts.back() != xmax) //hacky? yes. Apparently, it doesn't matter...?
-  //  xpts.push_back(xmax);
-  cout << xpts.back() << endl;
-  cout << xpts.size();
 
-  for (auto x : xpts)
-  {
-    string ypoint = "( " + m_tail[0].head().asSymbol() + " " + to_pstr(x, 5) + " )";
-    std::istringstream iss(ypoint);
-    TokenSequenceType tokens = tokenize(iss);
-    auto ast = parse(tokens);
-    if (ast == Expression())
-      std::cerr << "Error: bad contin plot input." << std::endl;
-    else {
-      try {
-        ypts.push_back(ast.eval(env).head().asNumber());
-        cout << "x: " <<x << " & y: ";
-        cout << ypts.back() << endl;
-      }
-      catch (const SemanticError & ex) {
-        std::cerr << ex.what() << std::endl;
-      }
-    }
-  }
-  if (ypts.size() != xpts.size()) {
-    return Expression();
-  }
+  ypts = sampleFunction(function, xpts, env);
+  refineSamples(function, xpts, ypts, budget, env);
+
   find_max_min(xmax, xmin, xpts);
   find_max_min(ymax, ymin, ypts);
 
-  /////////now we've got x&y lists
-  //a ^ 2 = b ^ 2 + c ^ 2 - 2bccosA
-  //(1)
-  //  b ^ 2 = a ^ 2 + c ^ 2 - 2accosB
-
-  //  (2)
-  //  c ^ 2 = a ^ 2 + b ^ 2 - 2abcosC.
-  cout << "\n";
-  
-  for (int passes = 0; passes < ITERs; ++passes) {
-    for (size_t i = 0; i < xpts.size() - 2; ++i) {
-      double p0x = xpts[i];
-      double p0y = ypts[i];
-      double p1x = xpts[i+1];
-      double p1y = ypts[i+1];
-      double p2x = xpts[i+2];
-      double p2y = ypts[i+2];
-      
-      double a = pow(p1x - p0x, 2) + pow(p1y - p0y, 2);
-      double b = pow(p1x - p2x, 2) + pow(p1y - p2y, 2);
-      double c = pow(p2x - p0x, 2) + pow(p2y - p0y, 2);
-      cout << a << " " << b << " " << c << " " << sqrt(4 * a*b) << " " << acos((a + b - c)) << endl;
-      //double angle = acos((a + b - c) / sqrt(4 * a*b));
-      double angleTop = acos(a + b - c);
-      double angleBot = sqrt(4 * a*b);
-      double angle = angleTop / angleBot / 3.14159265359 * 180.0;
-      //0.032 0.032 0.128 0.064 1.63484
-      //double angle2 = 1.63484 / 0.064 ;
-      cout << angle << endl;
-    }
-    break;
-  }
-  /*
-  function findAngle(p0,p1,p2) {
-  var a = Math.pow(p1.x-p0.x,2) + Math.pow(p1.y-p0.y,2),
-      b = Math.pow(p1.x-p2.x,2) + Math.pow(p1.y-p2.y,2),
-      c = Math.pow(p2.x-p0.x,2) + Math.pow(p2.y-p0.y,2);
-  return Math.acos( (a+b-c) / Math.sqrt(4*a*b) );
-}
-  */
-
-
   //scaling time
   for (size_t m = 0; m < xpts.size(); ++m) {
     xpts[m] *= N / (xmax - xmin);
     ypts[m] *= -N / (ymax - ymin);
   }
+  check_finite(xpts, "continuous-plot");
+  check_finite(ypts, "continuous-plot");
   find_max_min(pxmax, pxmin, xpts);
   find_max_min(pymax, pymin, ypts);
-  //cout << "\n pymax: " << pymax << " \t pymin: " << pymin << "\t diff " << pymin-pymax;
-  //cout << "\n pxmax: " << pxmax << " \t pxmin: " << pxmin << "\t diff " << pxmin-pxmax;
-
-  for (size_t i = 0; i < xpts.size() - 1; ++i)
-  {
-    string point1 = "(make-point " + to_pstr(xpts[i], 5) + " " + to_pstr(ypts[i], 5) + " )";
-    string point2 = "(make-point " + to_pstr(xpts[i + 1], 5) + " " + to_pstr(ypts[i + 1], 5) + " )";
-    list += "(set-property \"thickness\" 0 (make-line " + point1 + " " + point2 + " ) )";
-  }
 
-  list += boundingBoxCreatorCont(xpts, ypts);
-  //list += axisLineGenerator(xmax, ymax, xmin, ymin, pxmax, pymax, pxmin, pymin);
-  if (ymax >= 0 && ymin <= 0) {
-    string lp = "(make-point " + to_pstr(pxmin) + " " + to_pstr(0) + ") ";
-    string rp = "(make-point " + to_pstr(pxmax) + " " + to_pstr(0) + ") ";
-    axisLines += "(set-property \"thickness\" 0 ( make-line " + rp + lp + " )) ";
-  }
-  //else if (ymax < 0) { x_axis_pos = above; }
-  //else if (ymin > 0) { x_axis_pos = below; }
-  //cout << "\n ymax: " << ymax << " \t ymin: " << ymin << "\n";
-  if (xmax >= 0 && xmin <= 0) {
-    string tp = "(make-point " + to_pstr(0) + " " + to_pstr(pymin) + ") ";
-    string bp = "(make-point " + to_pstr(0) + " " + to_pstr(pymax) + ") ";
-    axisLines += "(set-property \"thickness\" 0 ( make-line " + tp + bp + " ))  ";
-  }
-  list += axisLines;
-
-  list += tickPointNumberGenerator(pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
-  if (m_tail.size() == 3) {
-    list += optionsGenerator(pxmax, pymax, pxmin, pymin, 2);
-  }
-  list += ")";
-  std::istringstream iss(list);
-  TokenSequenceType tokens = tokenize(iss);
-  auto ast = parse(tokens);
-  if (ast == Expression())
-    std::cerr << "Error: bad contin plot input." << std::endl;
-  else {
-    try {
-      continuousPlotList = ast.eval(env);
-    }
-    catch (const SemanticError & ex) {
-      std::cerr << ex.what() << std::endl;
-    }
+  // the curve is one polyline through the samples
+  std::vector<double> curve;
+  curve.reserve(2 * xpts.size());
+  for (size_t i = 0; i < xpts.size(); ++i) {
+    curve.push_back(rounded(xpts[i], 5));
+    curve.push_back(rounded(ypts[i], 5));
   }
-  return continuousPlotList;
-}
-
-// this is a simple recursive version. the iterative version is more
-// difficult with the ast data structure used (no parent pointer).
-// this limits the practical depth of our AST
-Expression Expression::eval(Environment & env){
-
-  bool interruptFlag = 0;
-  if(!env.testing)
-    if (env.interruptQ->try_pop(interruptFlag))  {
-      throw SemanticError("Error: interpreter kernel interrupted");
-    }
+  plot.appendExpression(makePolyline(std::move(curve), 0));
 
-  if (this->head().asSymbol() == "apply") {
-    Expression expr(applyOnList(m_tail));
-    return expr.eval(env);
-  }
-  if (this->head().asSymbol() == "map") {
-    Expression list = m_tail[1];
-    m_tail[1] = list.eval(env);
-    Expression expr(map(m_tail));
-    return expr.eval(env);
-  }
-  if (this->head().asSymbol() == "discrete-plot") {
-    if(m_tail.size() != 2)
-      throw SemanticError("Error in call to discrete-plot: invalid number of lists.");
-    Expression list = m_tail[0];
-    Expression list2 = m_tail[1];
-    m_tail[0] = list.eval(env);
-    m_tail[1] = list2.eval(env);
-    return handle_dPlot(env);
-  }
-  if (this->head().asSymbol() == "continuous-plot") {
-    if (m_tail.size() != 2 && m_tail.size() != 3)
-      throw SemanticError("Error in call to continuous-plot: invalid number of inputs. You have: " + to_pstr(m_tail.size()) + " inputs.");
-    Expression list2 = m_tail[1]; //bounds
-    if (m_tail.size() == 3) {
-      Expression list3 = m_tail[2]; //options
-      m_tail[2] = list3.eval(env);
-    }
-    m_tail[1] = list2.eval(env);
-    return handle_cPlot(env);
-  }
-  
-  if(m_tail.empty()){
-    if (this->head().asSymbol()[0] == '"' && this->head().asSymbol()[this->head().asSymbol().size()-1] == '"')
-      return *this;
-    return handle_lookup(m_head, env);
-  }
-  // handle begin special-form
-  else if(m_head.isSymbol() && m_head.asSymbol() == "begin"){
-    return handle_begin(env);
-  }
-  // handle define special-form
-  else if(m_head.isSymbol() && m_head.asSymbol() == "define"){
-    return handle_define(env);
-  }
-  // handle lambda special-form
-  else if(m_head.isLambda() && m_head.asSymbol() == "lambda"){ 
-    return handle_lambda();
-  }
-  // else attempt to treat as procedure
-  else{ 
-    std::vector<Expression> results;
-    for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-      results.push_back(it->eval(env));
-    }
-    if (env.get_exp(m_head).isHeadLambda()) {
-      Environment localEnv = localEnvMaker(env);
-      return callALambda(m_head, results, localEnv);
-      //return callALambda(m_head, results, env);
-    }
-    else {
-      return apply(m_head, results, env);
-    }
+  boundingBoxCreator(plot, xpts, ypts);
+  axisLineCreator(plot, pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
+  tickPointNumberGenerator(plot, pxmax, pymax, pxmin, pymin, xmax, ymax, xmin, ymin);
+  if (opts != nullptr) {
+    optionsGenerator(plot, *opts, "plot", 0, pxmax, pymax, pxmin, pymin);
   }
+  return plot;
 }
 
-Environment localEnvMaker(Environment env) {
-  //deep copy env
-  Environment localEnv(env);
-  return localEnv;
-}
-
-
-Expression callALambda(const Atom & op, const std::vector<Expression> & args, Environment & env) {
-  //TODO..try and break?
-
-  //we're dealing with lambda funct
-  Expression lambdafunc = env.get_exp(op);
-  //then turn args into map variables
-  auto inputList = lambdafunc.tailConstBegin();
-  size_t inputSize = 0;
-  for (auto e = (*inputList).tailConstBegin(); e != (*inputList).tailConstEnd(); ++e) {
-    inputSize++;
-  }
-  if (args.size() == inputSize) {
-    int i = 0;
-    for (auto e = (*inputList).tailConstBegin(); e != (*inputList).tailConstEnd(); ++e) {
-      env.add_exp((*e).head(), args[i]);
-      i++;
-    }
-  }
-  else {
-    throw SemanticError("Error in call to function: invalid number of arguments.");
-  }
-  //then pull the expression branch from the tail and send it to eval
-  auto functBody = lambdafunc.tailConstBegin() + 1;
-  Expression returnExpr(*functBody);
-  return returnExpr.eval(env); 
+Expression Expression::eval(Environment & env) const{
+  Evaluator evaluator;
+  return evaluator.run(*this, env);
 }
 
 
@@ -826,6 +891,21 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
   out << "(";
   out << exp.head();
 
+  // a polyline shows its vertices as points, a raster its cells
+  if (exp.packed() && exp.kind() == GraphicKind::Polyline) {
+    const std::vector<double> & xy = *exp.packed();
+    for (std::size_t i = 0; i + 1 < xy.size(); i += 2) {
+      Expression point(Atom("list"));
+      point.append(Atom(xy[i]));
+      point.append(Atom(xy[i + 1]));
+      out << " " << point;
+    }
+  }
+  else if (exp.packed()) {
+    for (double cell : *exp.packed())
+      out << " " << Expression(Atom(cell));
+  }
+
   int i = 0;
   for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
     
@@ -854,6 +934,10 @@ bool Expression::operator==(const Expression & exp) const noexcept{
 
   result = result && (m_tail.size() == exp.m_tail.size());
 
+  if (m_packed != exp.m_packed) {
+    result = result && m_packed && exp.m_packed && (*m_packed == *exp.m_packed);
+  }
+
   if(result){
     for(auto lefte = m_tail.begin(), righte = exp.m_tail.begin();
 	(lefte != m_tail.end()) && (righte != exp.m_tail.end());
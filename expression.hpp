@@ -17,6 +17,20 @@ Defines the Expression type and assiciated functions.
 // forward declare Environment
 class Environment;
 
+// forward declare Closure
+struct Closure;
+
+// forward declare MemoCache
+class MemoCache;
+
+// forward declare Future
+struct Future;
+
+/*! \enum GraphicKind
+\brief The graphic primitive an expression draws as, named by its "object-name" property.
+ */
+enum class GraphicKind { None, Point, Line, Text, Polyline, Raster };
+
 /*! \class Expression
 \brief An expression is a tree of Atoms.
 
@@ -42,6 +56,12 @@ public:
   /// deep-copy assign an expression  (recursive)
   Expression & operator=(const Expression & a);
 
+  /// move-construct an expression, taking over its tail and properties
+  Expression(Expression && a) noexcept;
+
+  /// move-assign an expression, taking over its tail and properties
+  Expression & operator=(Expression && a) noexcept;
+
   /// return a reference to the head Atom
   Atom & head();
 
@@ -54,6 +74,9 @@ public:
   /// append expression to tail of the expression
   void appendExpression(const Expression & a);
 
+  /// append expression to tail of the expression, taking over its contents
+  void appendExpression(Expression && a);
+
   /// return a pointer to the last expression in the tail, or nullptr
   Expression * tail();
 
@@ -76,26 +99,53 @@ public:
   
   bool isHeadLambda() const noexcept;
 
+  /// return the closure of a lambda value, or nullptr if this is not one
+  const std::shared_ptr<const Closure> & closure() const noexcept;
+
+  /// return a copy of this lambda value that calls through closure instead
+  Expression withClosure(std::shared_ptr<const Closure> closure) const;
+
+  /// return the pending result of a future value, or nullptr if this is not one
+  const std::shared_ptr<const Future> & future() const noexcept;
+
+  /// return a copy of this expression that stands for the pending result future
+  Expression withFuture(std::shared_ptr<const Future> future) const;
+
+  /// return the packed numbers of a polyline (x0 y0 x1 y1 ...) or raster (cells row by row), or nullptr
+  const std::shared_ptr<const std::vector<double>> & packed() const noexcept;
+
+  /// return a copy of this expression that holds the packed numbers
+  Expression withPacked(std::shared_ptr<const std::vector<double>> values) const;
+
   //returns nullptr if expression is not a point, else returns a pointer to an expression containing a point
   //Expression * toTypePoint() ;
 
+  /// the graphic primitive this is, None unless "object-name" names one
+  GraphicKind kind() const noexcept;
+
   bool isTypePoint() const noexcept;
   bool isTypeLine() const noexcept;
   bool isTypeText() const noexcept;
 
+  /// set property key to value, an "object-name" also sets kind()
+  void setProperty(const std::string & key, Expression value);
+
   //Expression getPointExpr();
 
-  /// Evaluate expression using a post-order traversal (recursive)
-  Expression eval(Environment & env);
+  /// Evaluate expression using a post-order traversal (see Evaluator), the expression is not modified
+  Expression eval(Environment & env) const;
 
   /// equality comparison for two expressions (recursive)
   bool operator==(const Expression & exp) const noexcept;
 
-  // property list
-  std::map<std::string, Expression> pList; 
+  /// the property list, changed only through setProperty
+  const std::map<std::string, Expression> & properties() const noexcept;
 
 private:
 
+  // the evaluator walks the tail directly
+  friend class Evaluator;
+
   // the head of the expression
   Atom m_head;
 
@@ -103,23 +153,60 @@ private:
   // and cache coherence, at the cost of wasted memory.
   std::vector<Expression> m_tail;
 
+  // the prepared form of a lambda value, shared between copies
+  std::shared_ptr<const Closure> m_closure;
+
+  // the result a future value waits for, shared between copies
+  std::shared_ptr<const Future> m_future;
+
+  // the vertices of a polyline or cells of a raster, packed and shared between copies
+  std::shared_ptr<const std::vector<double>> m_packed;
+
+  // the property list, "object-name" is set through setProperty so m_kind follows it
+  std::map<std::string, Expression> m_properties;
+
+  // the primitive "object-name" names, kept so drawing needs no lookup
+  GraphicKind m_kind = GraphicKind::None;
+
   // convenience typedef
   typedef std::vector<Expression>::iterator IteratorType;
   
   // internal helper methods
-  Expression handle_lookup(const Atom & head, const Environment & env);
-  Expression handle_define(Environment & env);
-  Expression handle_begin(Environment & env);
-  Expression handle_lambda();
-  Expression handle_dPlot(Environment & env);
-  std::string optionsGenerator(double pxmax, double pymax, double pxmin, double pymin, int tailpos);
-  Expression handle_cPlot(Environment & env);
+  Expression handle_lookup(const Atom & head, const Environment & env) const;
+  Expression handle_lambda(const std::shared_ptr<Environment> & scope) const;
+  // the plot builders take their evaluated arguments, opts may be nullptr
+  static Expression handle_dPlot(const Expression & data, const Expression & opts);
+  static Expression handle_densityPlot(const Expression & data, const Expression & opts);
+  static void optionsGenerator(Expression & plot, const Expression & opts, const std::string & name, double rotation, double pxmax, double pymax, double pxmin, double pymin);
+  static Expression handle_cPlot(const Expression & function, const Expression & bounds, const Expression * opts, Environment & env);
 };
 
+/*! \struct Closure
+\brief The runtime form of a lambda, prepared once when the lambda is evaluated.
+
+Calling a closure only binds the arguments to the parameter slots in a new
+local environment and continues with the body.
+ */
+struct Closure {
+
+  /// the parameter symbols in order, the arity is their count
+  std::vector<Atom> params;
 
-Environment localEnvMaker(Environment env);
+  /// the body evaluated on each call
+  Expression body;
 
-Expression callALambda(const Atom & op, const std::vector<Expression>& args, Environment & env);
+  /// a snapshot of the local frames the lambda was made in, which nothing
+  /// writes once it is taken, empty for the global environment
+  std::weak_ptr<Environment> scope;
+
+  /// keeps scope alive while the lambda is; empty for the global scope and
+  /// for the binding of a recursive lambda in its own scope, which would
+  /// own itself
+  std::shared_ptr<Environment> owner;
+
+  /// results of earlier calls, set only for lambdas made by memoize
+  std::shared_ptr<MemoCache> memo;
+};
 
 /// Render expression to output stream
 std::ostream & operator<<(std::ostream & out, const Expression & exp);
@@ -39,7 +39,7 @@ TEST_CASE("Test list expression", "[expression]") {
 TEST_CASE("Test property type getters", "[expression]") {
   Expression exp(Atom(22));
   Expression point(Atom("\"point\""));
-  exp.pList["\"object-name\""] = point;
+  exp.setProperty("\"object-name\"", point);
   REQUIRE(exp.isTypePoint());
   REQUIRE(!exp.isTypeLine());
 }
@@ -47,7 +47,7 @@ TEST_CASE("Test property type getters", "[expression]") {
 TEST_CASE("Test lproperty type getters 2", "[expression]") {
   Expression exp(Atom(22));
   Expression line(Atom("\"line\""));
-  exp.pList["\"object-name\""] = line;
+  exp.setProperty("\"object-name\"", line);
   REQUIRE(!exp.isTypePoint());
   REQUIRE(!exp.isTypeText());
   REQUIRE(exp.isTypeLine());
@@ -56,12 +56,30 @@ TEST_CASE("Test lproperty type getters 2", "[expression]") {
 TEST_CASE("Test lproperty type getters 3", "[expression]") {
   Expression exp(Atom(22));
   Expression text(Atom("\"text\""));
-  exp.pList["\"object-name\""] = text;
+  exp.setProperty("\"object-name\"", text);
   REQUIRE(!exp.isTypePoint());
   REQUIRE(exp.isTypeText());
   REQUIRE(!exp.isTypeLine());
 }
 
+TEST_CASE("Test graphic kinds follow the object name", "[expression]") {
+  Expression exp(Atom(22));
+  REQUIRE(exp.kind() == GraphicKind::None);
+
+  exp.setProperty("\"object-name\"", Expression(Atom("\"point\"")));
+  REQUIRE(exp.kind() == GraphicKind::Point);
+  Expression copy(exp);
+  REQUIRE(copy.kind() == GraphicKind::Point);
+  Expression moved(std::move(copy));
+  REQUIRE(moved.kind() == GraphicKind::Point);
+
+  exp.setProperty("\"size\"", Expression(Atom(2)));
+  REQUIRE(exp.kind() == GraphicKind::Point);
+  exp.setProperty("\"object-name\"", Expression(Atom("\"circle\"")));
+  REQUIRE(exp.kind() == GraphicKind::None);
+  REQUIRE(exp.properties().at("\"object-name\"") == Expression(Atom("\"circle\"")));
+}
+
 //TEST_CASE("make a bad lambda", "[expression]")
 //{
 //  Environment env;
@@ -70,7 +88,7 @@ TEST_CASE("Test lproperty type getters 3", "[expression]") {
 //  std::vector<Expression> vec;
 //  vec.push_back(e);
 //  vec.push_back(e2);
-//  REQUIRE_THROWS_AS(callALambda(Atom("I"), vec, env), SemanticError);
+//  REQUIRE_THROWS_AS(callALambda(Atom("I"), vec, env), const SemanticError &);
 //
 //
 //}
@@ -0,0 +1,33 @@
+/*! \file future.hpp
+Defines the pending result behind a future value.
+ */
+#ifndef FUTURE_HPP
+#define FUTURE_HPP
+
+#include <future>
+
+#include "expression.hpp"
+#include "thread_pool.hpp"
+
+/*! \struct Future
+\brief The result of an expression evaluated in the background by future.
+
+The expression runs as a task of the pool that was current when the future
+was made, or, without one, on the first thread to touch it. Every touch of
+the same future gets the same result, or the same error.
+ */
+struct Future {
+
+  /// the value of the expression, or the SemanticError it raised
+  std::shared_future<Expression> result;
+
+  /// the pool running the expression, nullptr if it runs when touched
+  ThreadPool * pool;
+
+  /// wait for the result, helping the pool with pending tasks meanwhile
+  Expression touch() const {
+    return (pool != nullptr) ? pool->wait(result) : result.get();
+  }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "graphics.hpp"
+
+Expression makePoint(double x, double y, double size){
+
+  Expression point(Atom("list"));
+  point.append(Atom(x));
+  point.append(Atom(y));
+  point.setProperty("\"object-name\"", Expression(Atom("\"point\"")));
+  point.setProperty("\"size\"", Expression(Atom(size)));
+  return point;
+}
+
+Expression makePoint(const Expression & x, const Expression & y, double size){
+
+  Expression point(Atom("list"));
+  point.appendExpression(x);
+  point.appendExpression(y);
+  point.setProperty("\"object-name\"", Expression(Atom("\"point\"")));
+  point.setProperty("\"size\"", Expression(Atom(size)));
+  return point;
+}
+
+Expression makeLine(const Expression & first, const Expression & second, double thickness){
+
+  Expression line(Atom("list"));
+  line.appendExpression(first);
+  line.appendExpression(second);
+  line.setProperty("\"object-name\"", Expression(Atom("\"line\"")));
+  line.setProperty("\"thickness\"", Expression(Atom(thickness)));
+  return line;
+}
+
+Expression makeText(const Expression & text, const Expression & position){
+
+  Expression result(text);
+  result.setProperty("\"object-name\"", Expression(Atom("\"text\"")));
+  result.setProperty("\"position\"", position);
+  return result;
+}
+
+Expression makePolyline(std::vector<double> coordinates, double thickness){
+
+  Expression polyline = Expression(Atom("polyline")).withPacked(
+    std::make_shared<const std::vector<double>>(std::move(coordinates)));
+  polyline.setProperty("\"object-name\"", Expression(Atom("\"polyline\"")));
+  polyline.setProperty("\"thickness\"", Expression(Atom(thickness)));
+  return polyline;
+}
+
+Expression makeRaster(std::vector<double> cells, std::size_t columns, const Expression & position, double width, double height){
+
+  Expression raster = Expression(Atom("raster")).withPacked(
+    std::make_shared<const std::vector<double>>(std::move(cells)));
+  raster.setProperty("\"object-name\"", Expression(Atom("\"raster\"")));
+  raster.setProperty("\"columns\"", Expression(Atom(double(columns))));
+  raster.setProperty("\"position\"", position);
+  raster.setProperty("\"width\"", Expression(Atom(width)));
+  raster.setProperty("\"height\"", Expression(Atom(height)));
+  return raster;
+}
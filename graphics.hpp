@@ -0,0 +1,64 @@
+/*! \file graphics.hpp
+Defines the constructors of the graphic primitives plots are made of.
+
+They back the make-point, make-line, make-text and make-polyline procedures of the
+environment as well as the plot procedures, so a primitive is the same
+Expression, property list included, however it was made.
+ */
+#ifndef GRAPHICS_HPP
+#define GRAPHICS_HPP
+
+#include <vector>
+
+#include "atom.hpp"
+#include "expression.hpp"
+
+/*! Build a point, as (make-point x y) with its "size" set.
+  \param x the abscissa
+  \param y the ordinate
+  \param size the value of the "size" property
+  \return the list (x y) with "object-name" "point"
+ */
+Expression makePoint(double x, double y, double size = 0);
+
+/*! Build a point from any two expressions, as (make-point x y).
+  \param x the first element
+  \param y the second element
+  \param size the value of the "size" property
+  \return the list (x y) with "object-name" "point"
+ */
+Expression makePoint(const Expression & x, const Expression & y, double size = 0);
+
+/*! Build a line, as (make-line first second) with its "thickness" set.
+  \param first the point the line starts at
+  \param second the point the line ends at
+  \param thickness the value of the "thickness" property
+  \return the list (first second) with "object-name" "line"
+ */
+Expression makeLine(const Expression & first, const Expression & second, double thickness = 1);
+
+/*! Build a text, as (make-text text) with its "position" set.
+  \param text the string to show, any properties it has are kept
+  \param position the point the text is centered on
+  \return the string with "object-name" "text"
+ */
+Expression makeText(const Expression & text, const Expression & position);
+
+/*! Build a polyline, as (make-polyline points) with its "thickness" set.
+  \param coordinates the vertices packed as x0 y0 x1 y1 ..., in drawing order
+  \param thickness the value of the "thickness" property
+  \return the polyline with "object-name" "polyline"
+ */
+Expression makePolyline(std::vector<double> coordinates, double thickness = 1);
+
+/*! Build a raster, a grid of cells drawn as one image.
+  \param cells the cell values row by row, the first row at the top
+  \param columns the number of cells in a row
+  \param position the point at the top left corner of the grid
+  \param width the width of the grid
+  \param height the height of the grid
+  \return the raster with "object-name" "raster", "columns", "position", "width" and "height"
+ */
+Expression makeRaster(std::vector<double> cells, std::size_t columns, const Expression & position, double width, double height);
+
+#endif
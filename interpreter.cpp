@@ -8,8 +8,23 @@
 #include "parse.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
+#include "optimize.hpp"
 #include "semantic_error.hpp"
-#include "message_queue.h"
+
+Interpreter::Interpreter(std::size_t workers):
+  shutdown(std::make_shared<CancelToken>()), pool(workers){}
+
+Interpreter::~Interpreter(){
+  // the pool joins its workers once this returns, unfinished futures stop first
+  shutdown->cancel();
+}
+
+void Interpreter::reset(){
+  shutdown->cancel();
+  shutdown = std::make_shared<CancelToken>();
+  env.reset();
+  ast = Expression();
+}
 
 bool Interpreter::parseStream(std::istream & expression) noexcept{
 
@@ -21,9 +36,24 @@ bool Interpreter::parseStream(std::istream & expression) noexcept{
 };
 				     
 
-Expression Interpreter::evaluate(message_queue<bool> * interruptQ, bool testing){
-  env.testing = testing;
-  env.interruptQ = interruptQ;
-  return ast.eval(env);
+void Interpreter::dumpOptimized(std::ostream * out) noexcept{
+  dump = out;
+}
+
+Expression Interpreter::evaluate(const CancelToken * cancel, const EvalLimits & limits){
+  env.cancel = cancel;
+  // cancel is not owned, futures watch it and the shutdown token
+  env.background = std::make_shared<CancelToken>(
+    std::shared_ptr<const CancelToken>(std::shared_ptr<const CancelToken>(), cancel), shutdown);
+
+  // builtins find the pool through ThreadPool::current
+  ThreadPool::Scope scope(&pool);
+
+  ast = optimize(ast, env);
+  if(dump != nullptr){
+    *dump << ast << std::endl;
+  }
+
+  return evaluator.run(ast, env, limits);
 }
 
@@ -9,11 +9,14 @@ It maintains an environment during evaluation.
 
 // system includes
 #include <istream>
+#include <ostream>
 #include <string>
 
 // module includes
 #include "environment.hpp"
+#include "evaluator.hpp"
 #include "expression.hpp"
+#include "thread_pool.hpp"
 
 /*! \class Interpreter
 \brief Class to parse and evaluate an expression (program)
@@ -25,17 +28,39 @@ The eval method updates Environment and returns last result.
 class Interpreter {
 public:
 
+  /*! Construct an interpreter with the default environment.
+    \param workers the number of threads in the pool parallel builtins run on
+   */
+  explicit Interpreter(std::size_t workers = ThreadPool::defaultWorkers());
+
+  /// stop the futures still running, then the workers
+  ~Interpreter();
+
+  /// return the environment to its default, dropping all definitions and
+  /// stopping the futures still running
+  void reset();
+
   /*! Parse into an internal Expression from a stream
     \param expression the raw text stream repreenting the candidate expression
     \return true on successful parsing 
    */
   bool parseStream(std::istream &expression) noexcept;
 
-  /*! Evaluate the Expression by walking the tree, returning the result.
+  /*! Write each program to out after constant folding, before it is evaluated.
+    \param out the stream to dump to, nullptr (the default) disables dumping
+   */
+  void dumpOptimized(std::ostream * out) noexcept;
+
+  /*! Fold constants in the Expression (see optimize), then evaluate it by
+      walking the tree, returning the result.
+    \param cancel a token that interrupts the evaluation when raised, or
+      nullptr; the futures it starts poll it too, so it must outlive them (or
+      the interpreter)
+    \param limits the step budget and deadline of this evaluation
     \return the Expression resulting from the evaluation in the current environment
     \throws SemanticError when a semantic error is encountered
    */
-  Expression evaluate(message_queue<bool> * interruptQ = nullptr, bool testing = true );
+  Expression evaluate(const CancelToken * cancel = nullptr, const EvalLimits & limits = EvalLimits());
 
 
   // the environment
@@ -45,6 +70,20 @@ private:
 
   // the AST
   Expression ast;
+
+  // reused between evaluations so its stacks keep their capacity
+  Evaluator evaluator;
+
+  // where to dump the optimized AST, if anywhere
+  std::ostream * dump = nullptr;
+
+  // raised to stop the futures of the environment on reset and destruction,
+  // replaced by a fresh one for the futures after a reset
+  std::shared_ptr<CancelToken> shutdown;
+
+  // the workers for parallel evaluation, declared last so that they stop
+  // before the environment their tasks use is destroyed
+  ThreadPool pool;
 };
 
 #endif
@@ -4,10 +4,18 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <cmath>
+#include <chrono>
+#include <thread>
 
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
+#include "future.hpp"
 #include "expression.hpp"
+#include "optimize.hpp"
+#include "parse.hpp"
+#include "evaluator.hpp"
+#include "memo.hpp"
 
 Expression run(const std::string & program){
   
@@ -271,7 +279,7 @@ TEST_CASE( "Test some semantically invalid expresions", "[interpreter]" ) {
       bool ok = interp.parseStream(iss);
       REQUIRE(ok == true);
       
-      //REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+      //REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
     }
 
 }
@@ -289,7 +297,7 @@ TEST_CASE( "Test for exceptions from semantically incorrect input", "[interprete
   bool ok = interp.parseStream(iss);
   REQUIRE(ok == true);
   
-  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 TEST_CASE( "Test malformed define", "[interpreter]" ) {
@@ -303,7 +311,7 @@ TEST_CASE( "Test malformed define", "[interpreter]" ) {
   bool ok = interp.parseStream(iss);
   REQUIRE(ok == true);
   
-  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 TEST_CASE( "Test using number as procedure", "[interpreter]" ) {
@@ -316,7 +324,7 @@ TEST_CASE( "Test using number as procedure", "[interpreter]" ) {
   bool ok = interp.parseStream(iss);
   REQUIRE(ok == true);
   
-  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 TEST_CASE("Testing pow", "[interpreter]") {
@@ -327,7 +335,7 @@ TEST_CASE("Testing pow", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == false);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -339,7 +347,7 @@ TEST_CASE("Testing neg", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == false);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -351,7 +359,7 @@ TEST_CASE("breaking begin", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -363,7 +371,7 @@ TEST_CASE("breaking lambda", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -375,7 +383,7 @@ TEST_CASE("breaking tan", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -387,7 +395,7 @@ TEST_CASE("breaking sin", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -399,7 +407,7 @@ TEST_CASE("breaking cos", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -411,7 +419,7 @@ TEST_CASE("breaking real", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -423,7 +431,7 @@ TEST_CASE("breaking imag", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -435,7 +443,7 @@ TEST_CASE("breaking mag", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -447,7 +455,7 @@ TEST_CASE("breaking arg", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -459,7 +467,7 @@ TEST_CASE("breaking conj", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -471,7 +479,7 @@ TEST_CASE("breaking first", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -483,7 +491,7 @@ TEST_CASE("breaking again", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 }
 
@@ -495,7 +503,7 @@ TEST_CASE("Testing define", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 
   {
@@ -505,7 +513,19 @@ TEST_CASE("Testing define", "[interpreter]") {
     std::istringstream iss(input);
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+
+  for(std::string input : {"(define + 1)", "(define sin (lambda (x) x))", "(define if 1)",
+	"(define future 1)", "(define x)",
+	"(begin (define f (lambda (x) (begin (define cos x) x))) (f 1))"}){
+    Interpreter interp;
+    INFO(input);
+    std::istringstream iss(input);
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+    REQUIRE(interp.env.is_proc(Atom("+")));
   }
 }
 
@@ -526,8 +546,8 @@ TEST_CASE("Testing defining lambda", "[interpreter]") {
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
     
-    CHECK_THROWS_AS(interp.evaluate(), SemanticError);
-    //REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    CHECK_THROWS_AS(interp.evaluate(), const SemanticError &);
+    //REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
   }
 
 }
@@ -559,6 +579,37 @@ TEST_CASE("Testing defining apply on list", "[interpreter]") {
 
 }
 
+TEST_CASE("Testing apply on an evaluated list", "[interpreter]") {
+  {
+    std::string input = "(begin (define l (range 0 9999 1)) (apply + l))";
+    INFO(input);
+    REQUIRE(run(input) == Expression(49995000.));
+  }
+
+  {
+    std::string input = "(apply max (range 1 5000 1))";
+    INFO(input);
+    REQUIRE(run(input) == Expression(5000.));
+  }
+
+  {
+    std::string input = "(begin (define f (lambda (x y) (* x y))) (apply f (list 3 4)))";
+    INFO(input);
+    REQUIRE(run(input) == Expression(12.));
+  }
+
+  {
+    Interpreter interp;
+    std::string input = "(apply + 1)";
+    std::istringstream iss(input);
+
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
 TEST_CASE("Testing defining map on list", "[interpreter]") {
   {
     std::string input = "(map + (list 1 2 3))";
@@ -576,6 +627,868 @@ TEST_CASE("Testing defining map on list", "[interpreter]") {
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
 
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+
+  {
+    std::string input = "(begin (define k 1) (map (lambda (x) (+ x k)) (list 1 2 3)))";
+    INFO(input);
+    REQUIRE(run(input) == run("(list 2 3 4)"));
+  }
+
+  {
+    std::string input = "(apply (lambda (x y) (* x y)) (list 3 4))";
+    INFO(input);
+    REQUIRE(run(input) == Expression(12.));
+  }
+
+  {
+    Interpreter interp;
+    std::istringstream iss("(map (+ 1 2) (list 1 2 3))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing if and comparisons", "[interpreter]") {
+  {
+    std::string input = "(if (< 1 2) 10 20)";
+    INFO(input);
+    REQUIRE(run(input) == Expression(10.));
+  }
+
+  {
+    std::string input = "(if (> 1 2) 10 20)";
+    INFO(input);
+    REQUIRE(run(input) == Expression(20.));
+  }
+
+  {
+    std::string input = "(if (= 2 2) (+ 1 1) undefined-symbol)";
+    INFO(input);
+    REQUIRE(run(input) == Expression(2.));
+  }
+
+  {
+    Interpreter interp;
+    std::string input = "(if (list 1) 1 2)";
+    std::istringstream iss(input);
+
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing deep recursion", "[interpreter]") {
+  {
+    INFO("tail calls run in constant stack");
+    std::string input = R"(
+(begin
+  (define count (lambda (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1)))))
+  (count 20000 0)))";
+    REQUIRE(run(input) == Expression(20000.));
+  }
+
+  {
+    INFO("non-tail calls do not use the native stack");
+    std::string input = R"(
+(begin
+  (define sum (lambda (n) (if (= n 0) 0 (+ n (sum (- n 1))))))
+  (sum 10000)))";
+    REQUIRE(run(input) == Expression(50005000.));
+  }
+
+  {
+    INFO("tail call through begin");
+    std::string input = R"(
+(begin
+  (define loop (lambda (n) (begin (define m (- n 1)) (if (< m 0) n (loop m)))))
+  (loop 20000)))";
+    REQUIRE(run(input) == Expression(0.));
+  }
+}
+
+TEST_CASE("Testing lambda closures", "[interpreter]") {
+  {
+    INFO("a lambda sees the frame it was defined in");
+    std::string input = R"(
+(begin
+  (define f (lambda (x) (begin (define g (lambda (y) (+ x y))) (g 1))))
+  (f 2)))";
+    REQUIRE(run(input) == Expression(3.));
+  }
+
+  {
+    INFO("a lambda returned from a call keeps the frame it was defined in");
+    std::string input = R"(
+(begin
+  (define x 100)
+  (define adder (lambda (x) (lambda (y) (+ x y))))
+  (define add1 (adder 1))
+  (add1 2)))";
+    REQUIRE(run(input) == Expression(3.));
+  }
+
+  {
+    INFO("so does a lambda defined in the frame and returned by name");
+    std::string input = R"(
+(begin
+  (define x 100)
+  (define adder (lambda (x) (begin (define g (lambda (y) (+ x y))) g)))
+  (define add5 (adder 5))
+  (+ (add5 1) (touch (future (add5 2))))))";
+    REQUIRE(run(input) == Expression(13.));
+  }
+
+  {
+    INFO("a local recursive lambda may return itself");
+    std::string input = R"(
+(begin
+  (define f (lambda (n) (begin (define go (lambda (k) (if (< k 1) go (go (- k 1))))) (go n))))
+  (define g (f 3))
+  (define h (g 2))
+  (h 0)))";
+    REQUIRE(run(input).isHeadLambda());
+  }
+
+  {
+    INFO("lambdas kept in the frame they were made in do not keep it alive");
+    Interpreter interp;
+    std::istringstream iss(R"(
+(begin
+  (define make (lambda (x)
+    (begin
+      (define adders (list (lambda (y) (+ x y)) (lambda (y) (- x y))))
+      (define pick (lambda (k) (if (< k 1) adders (pick (- k 1)))))
+      (pick 3))))
+  (make 2)))");
+    REQUIRE(interp.parseStream(iss));
+    Expression adders = interp.evaluate();
+    REQUIRE(adders.isHeadList());
+
+    std::weak_ptr<Environment> frame = adders.tailConstBegin()->closure()->owner;
+    REQUIRE(!frame.expired());
+    adders = Expression();
+    REQUIRE(frame.expired());
+  }
+
+  {
+    INFO("evaluating a lambda does not rewrite the program");
+    Interpreter interp;
+    std::istringstream iss("(lambda (x y) (+ x y))");
+    REQUIRE(interp.parseStream(iss));
+
+    Expression first = interp.evaluate();
+    Expression second = interp.evaluate();
+    REQUIRE(first == second);
+    REQUIRE(first.closure() != nullptr);
+    REQUIRE(first.closure()->params.size() == 2);
+  }
+
+  {
+    Interpreter interp;
+    std::istringstream iss("(begin (define f (lambda (x) x)) (f 1 2))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing constant folding", "[interpreter]") {
+
+  Environment env;
+  auto fold = [&env](const std::string & program){
+    std::istringstream iss(program);
+    return optimize(parse(tokenize(iss)), env);
+  };
+
+  {
+    INFO("nested pure calls and constants collapse to a number");
+    Expression folded = fold("(* 270 (/ pi 180))");
+    REQUIRE(folded == Expression(3 * std::atan2(0, -1) / 2));
+    REQUIRE(fold("(+ 1 I)") == Expression(std::complex<double>(1, 1)));
+    REQUIRE(fold("(< 1 2)") == Expression(1.));
+  }
+
+  {
+    INFO("lambda bodies are folded, parameters are not");
+    std::ostringstream out;
+    out << fold("(lambda (x) (* x (- 3 1)))");
+    REQUIRE(out.str() == "((x) (* (x) (2)))");
+  }
+
+  {
+    INFO("names bound by the program are left alone");
+    std::ostringstream out;
+    out << fold("(begin (define pi 3) (* pi 2))");
+    REQUIRE(out.str() == "(begin (define (pi) (3)) (* (pi) (2)))");
+    out.str("");
+    out << fold("(begin (define f (lambda (sin) (sin 1))) (cos pi))");
+    REQUIRE(out.str() == "(begin (define (f) ((sin) (sin (1)))) (-1))");
+  }
+
+  {
+    INFO("calls that fail are kept so the error happens at run time");
+    std::ostringstream out;
+    out << fold("(sqrt 1 2)");
+    REQUIRE(out.str() == "(sqrt (1) (2))");
+  }
+
+  {
+    INFO("folding does not change results");
+    REQUIRE(run("(begin (define f (lambda (x) (* x (/ pi 180)))) (f 180))") == Expression(std::atan2(0, -1)));
+    REQUIRE(run("(+ (sqrt (- 4)) 0)") == Expression(std::complex<double>(0, 2)));
+  }
+}
+
+TEST_CASE("Testing memoized lambdas", "[interpreter]") {
+  {
+    INFO("recursive calls reuse cached results");
+    std::string input = R"(
+(begin
+  (define fib (memoize (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))))
+  (fib 30)
+  (fib 30)
+  (memo-stats fib)))";
+    Expression stats = run(input);
+    std::vector<Expression> counts(stats.tailConstBegin(), stats.tailConstEnd());
+    REQUIRE(counts.size() == 5);
+    REQUIRE(counts[0] == Expression(29.)); // hits
+    REQUIRE(counts[1] == Expression(31.)); // misses
+    REQUIRE(counts[2] == Expression(0.));  // evictions
+    REQUIRE(counts[3] == Expression(31.)); // size
+    REQUIRE(counts[4] == Expression(1024.));
+    REQUIRE(run("(begin (define fib (memoize (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))) (fib 30))") == Expression(832040.));
+  }
+
+  {
+    INFO("the least recently used entry is evicted");
+    std::string input = R"(
+(begin
+  (define sq (memoize (lambda (x) (* x x)) 2))
+  (sq 1) (sq 2) (sq 1) (sq 3) (sq 1) (sq 2)
+  (memo-stats sq)))";
+    std::ostringstream out;
+    out << run(input);
+    REQUIRE(out.str() == "((2) (4) (2) (2) (2))");
+  }
+
+  {
+    INFO("arguments are compared exactly");
+    REQUIRE(run("(begin (define f (memoize (lambda (x) x))) (f 1) (f I) (f (list 1 2)) (f (list 1 2)) (first (memo-stats f)))") == Expression(1.));
+  }
+
+  {
+    INFO("errors");
+    for(auto s : {"(memoize 1)", "(memoize (lambda (x) x) 0)", "(memoize (lambda (x) x) 1.5)", "(memo-stats (lambda (x) x))"}){
+      Interpreter interp;
+      std::istringstream iss(s);
+      REQUIRE(interp.parseStream(iss));
+      REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+    }
+  }
+}
+
+TEST_CASE("Testing interrupts and evaluation limits", "[interpreter]") {
+
+  std::string loop = "(begin (define f (lambda (n) (f (+ n 1)))) (f 0))";
+
+  {
+    INFO("a raised token stops the evaluation");
+    Interpreter interp;
+    std::istringstream iss(loop);
+    REQUIRE(interp.parseStream(iss));
+    CancelToken token;
+    token.cancel();
+    REQUIRE_THROWS_AS(interp.evaluate(&token), const SemanticError &);
+
+    token.reset();
+    std::istringstream iss2("(+ 1 2)");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE(interp.evaluate(&token) == Expression(3.));
+  }
+
+  {
+    INFO("a token raised from another thread stops a runaway loop");
+    Interpreter interp;
+    std::istringstream iss(loop);
+    REQUIRE(interp.parseStream(iss));
+    CancelToken token;
+    std::thread canceller([&token](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      token.cancel();
+    });
+    REQUIRE_THROWS_AS(interp.evaluate(&token), const SemanticError &);
+    canceller.join();
+  }
+
+  {
+    INFO("the step budget bounds the nodes entered");
+    EvalLimits limits;
+    limits.maxSteps = 3;
+    Interpreter interp;
+    std::istringstream iss("(+ 1 2)");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate(nullptr, limits) == Expression(3.));
+
+    std::istringstream iss2(loop);
+    REQUIRE(interp.parseStream(iss2));
+    limits.maxSteps = 10000;
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+  }
+
+  {
+    INFO("the deadline bounds the wall-clock time");
+    EvalLimits limits;
+    limits.timeout = std::chrono::milliseconds(20);
+    Interpreter interp;
+    std::istringstream iss(loop);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing parallel map", "[interpreter]") {
+
+  std::string program = R"(
+(begin
+  (define k 10)
+  (define f (lambda (x) (begin (define y (* x k)) (+ y 1))))
+  (parallel-map f (range 0 20 1))))";
+
+  Expression expected = run("(begin (define k 10) (define f (lambda (x) (+ (* x k) 1))) (map f (range 0 20 1)))");
+
+  for(std::size_t workers : {0, 1, 4}){
+    INFO("results keep their order with " << workers << " workers");
+    Interpreter interp(workers);
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == expected);
+
+    INFO("definitions made by the tasks stay in their own frames");
+    REQUIRE(!interp.env.is_known(Atom("y")));
+  }
+
+  {
+    INFO("without a pool it is map");
+    std::istringstream iss(program);
+    Environment env;
+    Expression exp = parse(tokenize(iss));
+    REQUIRE(exp.eval(env) == expected);
+  }
+
+  {
+    INFO("errors in a task are reported");
+    Interpreter interp(2);
+    std::istringstream iss("(begin (define f (lambda (x) (first (list)))) (parallel-map f (list 1 2 3)))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+
+    std::istringstream iss2("(parallel-map 1 (list 1))");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+
+  {
+    INFO("the procedure may be any expression evaluating to a lambda");
+    Interpreter interp(2);
+    std::istringstream iss("(parallel-map (lambda (x) (* x x)) (list 1 2 3))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == run("(list 1 4 9)"));
+
+    std::istringstream iss2("(begin (define adder (lambda (k) (lambda (x) (+ x k)))) (parallel-map (adder 2) (list 1 2)))");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE(interp.evaluate() == run("(list 3 4)"));
+  }
+
+  {
+    INFO("the caller's limits bound the tasks");
+    std::string loops = "(begin (define f (lambda (n) (f (+ n 1)))) (parallel-map f (list 1 2 3 4)))";
+    Interpreter interp(2);
+
+    EvalLimits limits;
+    limits.timeout = std::chrono::milliseconds(50);
+    std::istringstream iss(loops);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+
+    limits = EvalLimits();
+    limits.maxSteps = 10000;
+    std::istringstream iss2(loops);
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+
+    INFO("the budget is shared, not given to each task");
+    std::istringstream iss3("(begin (define f (lambda (n) (if (< n 1) 0 (f (- n 1))))) (parallel-map f (list 400 400 400 400)))");
+    REQUIRE(interp.parseStream(iss3));
+    limits.maxSteps = 6000;
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+    std::istringstream iss4("(begin (define f (lambda (n) (if (< n 1) 0 (f (- n 1))))) (parallel-map f (list 400)))");
+    REQUIRE(interp.parseStream(iss4));
+    REQUIRE(interp.evaluate(nullptr, limits) == run("(list 0)"));
+    std::istringstream iss5("(begin (define f (lambda (n) (if (< n 1) 0 (f (- n 1))))) (parallel-map f (list 400 400 400 400)))");
+    REQUIRE(interp.parseStream(iss5));
+    limits.maxSteps = 100000;
+    REQUIRE(interp.evaluate(nullptr, limits) == run("(list 0 0 0 0)"));
+  }
+}
+
+TEST_CASE("Testing futures", "[interpreter]") {
+
+  std::string program = R"(
+(begin
+  (define k 10)
+  (define f (lambda (x) (begin (define y (* x k)) (+ y 1))))
+  (define a (future (f 2)))
+  (define b (future (apply + (range 1 100 1))))
+  (list (touch a) (touch b) (touch a) (touch 7))))";
+
+  Expression expected = run("(list 21 5050 21 7)");
+
+  for(std::size_t workers : {0, 1, 4}){
+    INFO("futures are touched for their value with " << workers << " workers");
+    Interpreter interp(workers);
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == expected);
+
+    INFO("definitions made by a future stay in its own environment");
+    REQUIRE(!interp.env.is_known(Atom("y")));
+
+    INFO("a future outlives the evaluation that made it");
+    std::istringstream iss2("(touch a)");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE(interp.evaluate() == Expression(21.));
+  }
+
+  {
+    INFO("a future sees the local frame it was made in");
+    REQUIRE(run("(begin (define g (lambda (x) (future (* x x)))) (touch (g 5)))") == Expression(25.));
+  }
+
+  {
+    INFO("without a pool the future runs when touched");
+    std::istringstream iss(program);
+    Environment env;
+    Expression exp = parse(tokenize(iss));
+    REQUIRE(exp.eval(env) == expected);
+  }
+
+  {
+    INFO("an error in a future is raised by touch");
+    Interpreter interp(2);
+    std::istringstream iss("(begin (define a (future (first (list)))) 1)");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == Expression(1.));
+
+    std::istringstream iss2("(touch a)");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+
+  {
+    INFO("an interrupt stops a future being touched");
+    CancelToken token;
+    Interpreter interp(2);
+    std::istringstream iss("(begin (define f (lambda (n) (f (+ n 1)))) (touch (future (f 0))))");
+    REQUIRE(interp.parseStream(iss));
+    std::thread canceller([&token](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      token.cancel();
+    });
+    REQUIRE_THROWS_AS(interp.evaluate(&token), const SemanticError &);
+    canceller.join();
+  }
+
+  std::string runaway = "(begin (define f (lambda (n) (f (+ n 1)))) (future (f 0)))";
+
+  {
+    INFO("a reset stops the futures still running");
+    Interpreter interp(2);
+    std::istringstream iss(runaway);
+    REQUIRE(interp.parseStream(iss));
+    Expression future = interp.evaluate();
+    REQUIRE(future.future());
+    interp.reset();
+    REQUIRE_THROWS_AS(future.future()->touch(), const SemanticError &);
+
+    std::istringstream iss2("(touch (future (+ 1 2)))");
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE(interp.evaluate() == Expression(3.));
+  }
+
+  {
+    INFO("an interrupt after the evaluation stops its futures");
+    CancelToken token;
+    Interpreter interp(2);
+    std::istringstream iss(runaway);
+    REQUIRE(interp.parseStream(iss));
+    Expression future = interp.evaluate(&token);
+    token.cancel();
+    REQUIRE_THROWS_AS(future.future()->touch(), const SemanticError &);
+  }
+
+  {
+    INFO("tasks do not read the frame their caller goes on defining in");
+    std::string defines;
+    for(int i = 0; i < 200; ++i){
+      defines += "(define d" + std::to_string(i) + " " + std::to_string(i) + ")\n";
+    }
+    std::string program = R"(
+(begin
+  (define count (lambda (k) (if (< k 1) 0 (+ 1 (count (- k 1))))))
+  (define f (lambda (n)
+    (begin
+      (define g (lambda (k) (+ (count k) n)))
+      (define a (future (g 300)))
+      (define b (parallel-map g (list 100 200)))
+      )" + defines + R"(
+      (list (touch a) b d199))))
+  (f 1)))";
+    for(int repeat = 0; repeat < 5; ++repeat){
+      Interpreter interp(2);
+      std::istringstream iss(program);
+      REQUIRE(interp.parseStream(iss));
+      REQUIRE(interp.evaluate() == run("(list 301 (list 101 201) 199)"));
+    }
+  }
+
+  {
+    INFO("an interpreter does not wait for a future nobody touches");
+    Interpreter interp(2);
+    std::istringstream iss("(begin (define f (lambda (n) (f (+ n 1)))) (define a (future (f 0))) 1)");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == Expression(1.));
+  }
+
+  {
+    INFO("the caller's limits bound the task");
+    std::string touched = "(begin (define f (lambda (n) (f (+ n 1)))) (define a (future (f 0))) (touch a))";
+    Interpreter interp(2);
+
+    EvalLimits limits;
+    limits.timeout = std::chrono::milliseconds(50);
+    std::istringstream iss(touched);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+
+    limits = EvalLimits();
+    limits.maxSteps = 10000;
+    std::istringstream iss2(touched);
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing one program evaluated concurrently", "[interpreter]") {
+
+  std::string program = R"(
+(begin
+  (define f (lambda (x) (list x (+ (* 2 x) 1))))
+  (define g (lambda (x) (* x x)))
+  (list (map g (range 0 10 1))
+        (apply + (list 1 2 3))
+        (discrete-plot (map f (range -2 2 1)) (list (list "title" "T")))))
+)";
+
+  std::istringstream iss(program);
+  const Expression ast = parse(tokenize(iss));
+  const Expression original = ast;
+
+  Environment env;
+  Expression expected = ast.eval(env);
+  REQUIRE(ast == original);
+
+  // each thread has its own environment, the program is shared
+  std::vector<Expression> results(4);
+  std::vector<std::thread> threads;
+  for(std::size_t i = 0; i < results.size(); ++i){
+    threads.emplace_back([&ast, &results, i](){
+      Environment local;
+      results[i] = ast.eval(local);
+    });
+  }
+  for(auto & t : threads){
+    t.join();
+  }
+
+  for(auto & result : results){
+    REQUIRE(result == expected);
+  }
+  REQUIRE(ast == original);
+}
+
+TEST_CASE("Testing discrete plot", "[interpreter]") {
+
+  std::string input = R"(
+(discrete-plot (list (list -1 -1) (list 1 1))
+  (list (list "title" "The Title") (list "ordinate-label" "Y Label") (list "text-scale" 2))))";
+
+  Expression plot = run(input);
+  REQUIRE(plot.isHeadList());
+
+  // 2 points, 4 box lines, 2 axes, 2 stems, 2 labels and 4 tick numbers
+  std::vector<Expression> items(plot.tailConstBegin(), plot.tailConstEnd());
+  REQUIRE(items.size() == 16);
+
+  Expression point = items[0];
+  REQUIRE(point.isTypePoint());
+  REQUIRE(point == run("(list -10 10)"));
+  REQUIRE(point.properties().at("\"size\"") == Expression(0.5));
+
+  Expression stem = items[8];
+  REQUIRE(stem.isTypeLine());
+  REQUIRE(stem.properties().at("\"thickness\"") == Expression(0.));
+  REQUIRE(*stem.tailConstBegin() == point);
+
+  Expression label = items[11];
+  REQUIRE(label.isTypeText());
+  REQUIRE(label == Expression(Atom("\"Y Label\"")));
+  REQUIRE(label.properties().at("\"text-scale\"") == Expression(2.));
+  REQUIRE(std::fabs(label.properties().at("\"text-rotation\"").head().asNumber() - 1.5 * std::atan2(0, -1)) < 1e-12);
+  REQUIRE(label.properties().at("\"position\"").isTypePoint());
+
+  INFO("labels must be strings and the data must have an extent");
+  for(std::string bad : {"(discrete-plot (list (list 1 2) (list 3 7)) (list (list \"title\" 5)))",
+	"(discrete-plot (list (list 1 2) (list 1 2)) (list))"}){
+    Interpreter interp;
+    std::istringstream iss(bad);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing calls through the evaluator", "[interpreter]") {
+
+  Interpreter interp;
+  std::istringstream iss("(begin (define k 10) (define f (lambda (x y) (+ (* k x) y))) (define m (memoize f)))");
+  REQUIRE(interp.parseStream(iss));
+  interp.evaluate();
+
+  Evaluator evaluator;
+  std::vector<Expression> args = {Expression(0.1234567), Expression(1.)};
+  Expression f = interp.env.get_exp(Atom("f"));
+  REQUIRE(evaluator.call(f, args, interp.env) == Expression(10 * 0.1234567 + 1));
+
+  Expression m = interp.env.get_exp(Atom("m"));
+  REQUIRE(evaluator.call(m, args, interp.env) == Expression(10 * 0.1234567 + 1));
+  REQUIRE(evaluator.call(m, args, interp.env) == Expression(10 * 0.1234567 + 1));
+  REQUIRE(m.closure()->memo->stats().hits == 1);
+
+  REQUIRE(evaluator.call(Expression(Atom("+")), args, interp.env) == Expression(1.1234567));
+
+  std::vector<Expression> one = {Expression(1.)};
+  REQUIRE_THROWS_AS(evaluator.call(f, one, interp.env), const SemanticError &);
+  REQUIRE_THROWS_AS(evaluator.call(Expression(1.), one, interp.env), const SemanticError &);
+}
+
+TEST_CASE("Testing graphic primitive procedures", "[interpreter]") {
+
+  INFO("the same as the procedures built from set-property");
+  REQUIRE(run("(make-point 1 2)") ==
+	  run("(set-property \"size\" 0 (set-property \"object-name\" \"point\" (list 1 2)))"));
+  REQUIRE(run("(make-line (make-point 1 2) (make-point 3 4))") ==
+	  run("(set-property \"thickness\" 1 (set-property \"object-name\" \"line\" (list (make-point 1 2) (make-point 3 4))))"));
+  REQUIRE(run("(make-text \"hi\")") ==
+	  run("(set-property \"position\" (make-point 0 0) (set-property \"object-name\" \"text\" \"hi\"))"));
+
+  Expression point = run("(make-point 1 2)");
+  REQUIRE(point.properties().at("\"object-name\"") == Expression(Atom("\"point\"")));
+  REQUIRE(point.properties().at("\"size\"") == Expression(0.));
+  REQUIRE(run("(get-property \"object-name\" (make-text \"hi\"))") == Expression(Atom("\"text\"")));
+  REQUIRE(run("(set-property \"object-name\" \"line\" (list (make-point 1 2) (make-point 3 4)))").isTypeLine());
+  REQUIRE(run("(make-text \"hi\")").kind() == GraphicKind::Text);
+  REQUIRE(run("(get-property \"thickness\" (set-property \"thickness\" 4 (make-line (make-point 1 2) (make-point 3 4))))") == Expression(4.));
+
+  INFO("a polyline packs its points");
+  Expression polyline = run("(make-polyline (list (make-point 0 0) (make-point 1 2) (list 3 -1)))");
+  REQUIRE(polyline.kind() == GraphicKind::Polyline);
+  REQUIRE(*polyline.packed() == std::vector<double>({0, 0, 1, 2, 3, -1}));
+  REQUIRE(polyline.properties().at("\"thickness\"") == Expression(1.));
+  REQUIRE(run("(get-property \"object-name\" (make-polyline (list)))") == Expression(Atom("\"polyline\"")));
+  REQUIRE(polyline != run("(make-polyline (list (make-point 0 0) (make-point 1 2)))"));
+  REQUIRE(run("(first (list (make-polyline (list (make-point 0 0) (make-point 1 2)))))") ==
+	  run("(make-polyline (list (make-point 0 0) (make-point 1 2)))"));
+  std::ostringstream printed;
+  printed << run("(make-polyline (list (make-point 0 0) (make-point 1 2)))");
+  REQUIRE(printed.str() == "(polyline ((0) (0)) ((1) (2)))");
+
+  for(std::string bad : {"(make-point 1)", "(make-line (make-point 1 2))", "(make-text \"a\" \"b\")",
+	"(make-polyline 1)", "(make-polyline (list (make-point 1 2) 3))", "(make-polyline (list (list 1 I)))"}){
+    Interpreter interp;
+    std::istringstream iss(bad);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing discrete plot decimation", "[interpreter]") {
+
+  std::string data = "(begin (define f (lambda (x) (list x (if (= x 500) 10 (sin x))))) (discrete-plot (map f (range 0 999 1)) ";
+  Expression full = run(data + "(list)))");
+  Expression fewer = run(data + "(list (list \"max-points\" 100))))");
+
+  std::vector<Expression> all(full.tailConstBegin(), full.tailConstEnd());
+  std::vector<Expression> kept(fewer.tailConstBegin(), fewer.tailConstEnd());
+
+  INFO("points and stems, then the same box, axes and ticks");
+  REQUIRE(all.size() == 1000 + 1000 + 4 + 2 + 4);
+  REQUIRE(kept.size() == 100 + 100 + 4 + 2 + 4);
+  REQUIRE(std::equal(kept.begin() + 100, kept.begin() + 106, all.begin() + 1000));
+  REQUIRE(std::equal(kept.end() - 4, kept.end(), all.end() - 4));
+
+  INFO("the ends and the spike are kept");
+  REQUIRE(kept.front() == all.front());
+  REQUIRE(kept[99] == all[999]);
+  REQUIRE(std::find(kept.begin(), kept.begin() + 100, all[500]) != kept.begin() + 100);
+
+  INFO("a short series is drawn as it is");
+  REQUIRE(run("(discrete-plot (list (list 1 2) (list 3 7)) (list (list \"max-points\" 2)))") ==
+	  run("(discrete-plot (list (list 1 2) (list 3 7)) (list))"));
+
+  Interpreter interp;
+  std::istringstream iss("(discrete-plot (list (list 1 2) (list 3 7)) (list (list \"max-points\" 1)))");
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+}
+
+TEST_CASE("Testing density plot", "[interpreter]") {
+
+  std::string data = "(begin (define f (lambda (i) (list (sin i) (* 2 (cos (* 3 i)))))) (density-plot (map f (range 0 9999 1)) ";
+  Expression plot = run(data + "(list (list \"resolution\" 8) (list \"title\" \"D\"))))");
+
+  // the raster, 4 box lines, 2 axes, a title and 4 tick numbers
+  std::vector<Expression> items(plot.tailConstBegin(), plot.tailConstEnd());
+  REQUIRE(items.size() == 12);
+
+  Expression raster = items[0];
+  REQUIRE(raster.kind() == GraphicKind::Raster);
+  REQUIRE(raster.properties().at("\"columns\"") == Expression(8.));
+  REQUIRE(raster.packed()->size() == 64);
+  double total = 0;
+  for (double cell : *raster.packed()) total += cell;
+  REQUIRE(total == 10000);
+  REQUIRE(raster.properties().at("\"width\"") == Expression(20.));
+  REQUIRE(raster.properties().at("\"height\"") == Expression(20.));
+  REQUIRE(raster.properties().at("\"position\"").isTypePoint());
+
+  INFO("the frame is the one discrete-plot draws for the same data");
+  Expression discrete = run("(begin (define f (lambda (i) (list (sin i) (* 2 (cos (* 3 i)))))) (discrete-plot (map f (range 0 9999 1)) (list)))");
+  REQUIRE(std::equal(items.begin() + 1, items.begin() + 7, discrete.tailConstBegin() + 10000));
+  REQUIRE(std::equal(items.end() - 4, items.end(), discrete.tailConstEnd() - 4));
+
+  {
+    INFO("the counts do not depend on the number of workers");
+    Interpreter interp(3);
+    std::istringstream iss(data + "(list (list \"resolution\" 8))))");
+    REQUIRE(interp.parseStream(iss));
+    Expression parallel = interp.evaluate();
+    REQUIRE(*parallel.tailConstBegin()->packed() == *raster.packed());
+  }
+
+  INFO("a top left cell for the top left point");
+  Expression corners = run("(density-plot (list (list 0 1) (list 1 0) (list 1 0)) (list (list \"resolution\" 2)))");
+  REQUIRE(*corners.tailConstBegin()->packed() == std::vector<double>({1, 0, 0, 2}));
+
+  for(std::string bad : {"(density-plot (list) (list))",
+	"(density-plot (list (list 1 2) (list 1 3)) (list))",
+	"(density-plot (list (list 1 2) 3) (list))",
+	"(density-plot (list (list 1 2) (list 2 3)) (list (list \"resolution\" 1)))",
+	"(density-plot (list (list 1 2) (list 2 3)) (list (list \"resolution\" 100000)))",
+	"(density-plot (list (list 1 2) (list 2 3)))"}){
+    Interpreter interp;
+    std::istringstream iss(bad);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing continuous plot functions", "[interpreter]") {
+
+  Expression named = run("(begin (define f (lambda (x) (* x x))) (continuous-plot f (list -2 2)))");
+  REQUIRE(named.isHeadList());
+  REQUIRE(run("(continuous-plot (lambda (x) (* x x)) (list -2 2))") == named);
+  REQUIRE(run("(continuous-plot sin (list -2 2))").isHeadList());
+
+  for(std::string bad : {"(continuous-plot 5 (list -2 2))",
+	"(continuous-plot (lambda (x) (list x)) (list -2 2))",
+	"(continuous-plot sin (list -2 2) (list (list \"max-samples\" 1)))",
+	"(continuous-plot sin (list -2 2) (list (list \"max-samples\" 2.5)))",
+	"(continuous-plot sin (list))",
+	"(continuous-plot sin (list 1))",
+	"(continuous-plot sin (list 1 2 3))",
+	"(continuous-plot sin (list 1 I))",
+	"(continuous-plot sin 2)",
+	"(continuous-plot sin (list 1 1))"}){
+    Interpreter interp;
+    std::istringstream iss(bad);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
+  }
+}
+
+TEST_CASE("Testing continuous plot refinement", "[interpreter]") {
+
+  // the segments of the curve, drawn as the plot's one polyline
+  auto segments = [](const Expression & plot){
+    std::size_t count = 0;
+    for(auto e = plot.tailConstBegin(); e != plot.tailConstEnd(); ++e){
+      if(e->kind() == GraphicKind::Polyline){
+	count += e->packed()->size() / 2 - 1;
+      }
+    }
+    return count;
+  };
+
+  INFO("a straight line keeps the coarse grid");
+  REQUIRE(segments(run("(continuous-plot (lambda (x) (* 2 x)) (list -2 2))")) == 50);
+
+  INFO("a step is sampled more densely, within the budget");
+  std::string step = "(continuous-plot (lambda (x) (if (< x 0.3) 0 1)) (list -2 2)";
+  std::size_t refined = segments(run(step + ")"));
+  REQUIRE(refined > 50);
+  REQUIRE(refined < 999);
+  REQUIRE(segments(run(step + " (list (list \"max-samples\" 60)))")) == 59);
+  REQUIRE(segments(run(step + " (list (list \"max-samples\" 10)))")) == 9);
+
+  {
+    INFO("sampling on a pool gives the same plot");
+    Interpreter interp(4);
+    std::istringstream iss("(begin (define f (lambda (x) (if (< x 0.3) (sin x) (* 2 x)))) (continuous-plot f (list -2 2)))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE(interp.evaluate() == run("(continuous-plot (lambda (x) (if (< x 0.3) (sin x) (* 2 x))) (list -2 2))"));
+  }
+
+  {
+    INFO("an interrupt stops every sampling task");
+    CancelToken token;
+    Interpreter interp(4);
+    std::istringstream iss("(begin (define f (lambda (n) (f (+ n 1)))) (continuous-plot (lambda (x) (f x)) (list 0 1)))");
+    REQUIRE(interp.parseStream(iss));
+    std::thread canceller([&token](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      token.cancel();
+    });
+    REQUIRE_THROWS_AS(interp.evaluate(&token), const SemanticError &);
+    canceller.join();
+  }
+
+  for(std::size_t workers : {0, 4}){
+    INFO("the caller's limits bound the sampling with " << workers << " workers");
+    std::string loops = "(begin (define f (lambda (n) (f (+ n 1)))) (continuous-plot (lambda (x) (f x)) (list 0 1)))";
+    Interpreter interp(workers);
+
+    EvalLimits limits;
+    limits.timeout = std::chrono::milliseconds(50);
+    std::istringstream iss(loops);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
+
+    limits = EvalLimits();
+    limits.maxSteps = 10000;
+    std::istringstream iss2(loops);
+    REQUIRE(interp.parseStream(iss2));
+    REQUIRE_THROWS_AS(interp.evaluate(nullptr, limits), const SemanticError &);
   }
 }
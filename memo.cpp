@@ -0,0 +1,163 @@
+#include "memo.hpp"
+
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace {
+
+void combine(std::size_t & seed, std::size_t value){
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+std::size_t hashDouble(double d){
+  // 0.0 and -0.0 compare equal, so they must hash alike
+  if(d == 0) d = 0;
+  return std::hash<double>()(d);
+}
+
+bool sameDouble(double left, double right){
+  return std::memcmp(&left, &right, sizeof(double)) == 0 || (left == 0 && right == 0);
+}
+
+std::size_t hashExpression(const Expression & exp){
+
+  const Atom & head = exp.head();
+  std::size_t seed = 0;
+
+  if(head.isNumber()){
+    combine(seed, 1);
+    combine(seed, hashDouble(head.asNumber()));
+  }
+  else if(head.isComplexNumber()){
+    combine(seed, 2);
+    combine(seed, hashDouble(head.asComplexNumber().real()));
+    combine(seed, hashDouble(head.asComplexNumber().imag()));
+  }
+  else{
+    combine(seed, 3);
+    combine(seed, std::hash<std::string>()(head.asSymbol()));
+  }
+
+  for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
+    combine(seed, hashExpression(*e));
+  }
+
+  return seed;
+}
+
+bool sameExpression(const Expression & left, const Expression & right){
+
+  const Atom & a = left.head();
+  const Atom & b = right.head();
+
+  if(a.isNumber() || b.isNumber()){
+    if(!a.isNumber() || !b.isNumber() || !sameDouble(a.asNumber(), b.asNumber())) return false;
+  }
+  else if(a.isComplexNumber() || b.isComplexNumber()){
+    if(!a.isComplexNumber() || !b.isComplexNumber() ||
+       !sameDouble(a.asComplexNumber().real(), b.asComplexNumber().real()) ||
+       !sameDouble(a.asComplexNumber().imag(), b.asComplexNumber().imag())) return false;
+  }
+  else if(!(a == b)){
+    return false;
+  }
+
+  // lambda values are only interchangeable if they share their closure
+  if(left.closure() != right.closure()) return false;
+
+  if(left.packed() != right.packed() &&
+     (!left.packed() || !right.packed() || *left.packed() != *right.packed())) return false;
+
+  if(left.properties().size() != right.properties().size()) return false;
+  for(auto l = left.properties().begin(), r = right.properties().begin(); l != left.properties().end(); ++l, ++r){
+    if(l->first != r->first || !sameExpression(l->second, r->second)) return false;
+  }
+
+  auto l = left.tailConstBegin();
+  auto r = right.tailConstBegin();
+  for(; l != left.tailConstEnd() && r != right.tailConstEnd(); ++l, ++r){
+    if(!sameExpression(*l, *r)) return false;
+  }
+  return (l == left.tailConstEnd()) && (r == right.tailConstEnd());
+}
+
+std::size_t hashArguments(Arguments args){
+  std::size_t seed = args.size();
+  for(auto & a : args){
+    combine(seed, hashExpression(a));
+  }
+  return seed;
+}
+
+} // namespace
+
+MemoCache::MemoCache(std::size_t capacity)
+  : m_capacity(capacity), m_stats{0, 0, 0, 0, capacity} {}
+
+MemoCache::EntryList::iterator MemoCache::lookup(std::size_t hash, Arguments args){
+
+  auto range = m_index.equal_range(hash);
+  for(auto pos = range.first; pos != range.second; ++pos){
+    const std::vector<Expression> & key = pos->second->args;
+    if(key.size() != args.size()) continue;
+
+    bool same = true;
+    for(std::size_t i = 0; same && i < key.size(); ++i){
+      same = sameExpression(key[i], args[i]);
+    }
+    if(same) return pos->second;
+  }
+  return m_entries.end();
+}
+
+bool MemoCache::find(Arguments args, Expression & result){
+
+  std::size_t hash = hashArguments(args);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto pos = lookup(hash, args);
+  if(pos == m_entries.end()){
+    ++m_stats.misses;
+    return false;
+  }
+
+  // move to the front, the most recently used end
+  m_entries.splice(m_entries.begin(), m_entries, pos);
+  ++m_stats.hits;
+  result = pos->result;
+  return true;
+}
+
+void MemoCache::insert(Arguments args, const Expression & result){
+
+  if(m_capacity == 0) return;
+
+  std::size_t hash = hashArguments(args);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // another evaluation may have stored the same call meanwhile
+  if(lookup(hash, args) != m_entries.end()) return;
+
+  if(m_entries.size() == m_capacity){
+    const Entry & oldest = m_entries.back();
+    auto range = m_index.equal_range(oldest.hash);
+    for(auto pos = range.first; pos != range.second; ++pos){
+      if(&*pos->second == &oldest){
+        m_index.erase(pos);
+        break;
+      }
+    }
+    m_entries.pop_back();
+    ++m_stats.evictions;
+  }
+
+  m_entries.push_front(Entry{hash, std::vector<Expression>(args.begin(), args.end()), result});
+  m_index.emplace(hash, m_entries.begin());
+  m_stats.size = m_entries.size();
+}
+
+MemoStats MemoCache::stats() const{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
@@ -0,0 +1,90 @@
+/*! \file memo.hpp
+Defines the result cache attached to memoized lambdas.
+ */
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \struct MemoStats
+\brief A snapshot of the counters of a MemoCache.
+ */
+struct MemoStats {
+  /// calls answered from the cache
+  std::size_t hits;
+
+  /// calls that evaluated the body
+  std::size_t misses;
+
+  /// entries dropped to stay within capacity
+  std::size_t evictions;
+
+  /// entries currently cached
+  std::size_t size;
+
+  /// the most entries the cache holds
+  std::size_t capacity;
+};
+
+/*! \class MemoCache
+\brief A bounded least-recently-used map from argument lists to results.
+
+Arguments are keyed by a structural hash and compared exactly, numbers bit
+for bit and lambda values by closure identity, so only calls that are
+indistinguishable to the body share a result. A cache may be shared by
+several evaluations at once, all members lock an internal mutex.
+ */
+class MemoCache {
+public:
+
+  /// the capacity used by (memoize f)
+  static const std::size_t defaultCapacity = 1024;
+
+  /// construct an empty cache holding at most capacity entries
+  explicit MemoCache(std::size_t capacity = defaultCapacity);
+
+  /*! Look up the result of a call, marking it most recently used.
+    \param args the evaluated arguments of the call
+    \param result set to the cached result when found
+    \return true if the call was cached
+   */
+  bool find(Arguments args, Expression & result);
+
+  /*! Cache the result of a call, evicting the least recently used entry
+      when the cache is full.
+    \param args the evaluated arguments of the call
+    \param result the value the body evaluated to
+   */
+  void insert(Arguments args, const Expression & result);
+
+  /// return the current counters
+  MemoStats stats() const;
+
+private:
+
+  struct Entry {
+    std::size_t hash;
+    std::vector<Expression> args;
+    Expression result;
+  };
+
+  // most recently used first
+  typedef std::list<Entry> EntryList;
+
+  mutable std::mutex m_mutex;
+  std::size_t m_capacity;
+  EntryList m_entries;
+  std::unordered_multimap<std::size_t, EntryList::iterator> m_index;
+  MemoStats m_stats;
+
+  EntryList::iterator lookup(std::size_t hash, Arguments args);
+};
+
+#endif
@@ -5,6 +5,7 @@ www.justsoftwaresolutions.co.uk/threading/implementing-a-thread-safe-queue-using
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 #include "expression.hpp"
 
 template<typename MessageType>
@@ -20,6 +21,14 @@ class message_queue
     the_condition_variable.notify_one();
   }
 
+  void push(MessageType&& message)
+  {
+    std::unique_lock<std::mutex> lock(the_mutex);
+    the_queue.push(std::move(message));
+    lock.unlock();
+    the_condition_variable.notify_one();
+  }
+
   bool empty() const
   {
     std::lock_guard<std::mutex> lock(the_mutex);
@@ -34,7 +43,7 @@ class message_queue
 	return false;
       }
         
-    popped_value=the_queue.front();
+    popped_value=std::move(the_queue.front());
     the_queue.pop();
     return true;
   }
@@ -47,7 +56,7 @@ class message_queue
 	the_condition_variable.wait(lock);
       }
         
-    popped_value=the_queue.front();
+    popped_value=std::move(the_queue.front());
     the_queue.pop();
   }
 
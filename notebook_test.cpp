@@ -13,6 +13,8 @@ private slots:
   void testPointArray();
   void testTextArray();
   void testLineArray();
+  void testPolylinePath();
+  void testDensityRaster();
   void testDiscretePlotLayout();
   void testDiscretePlot_linear(); //TODO FIXERup? or del
   void test_start_stop();
@@ -94,6 +96,41 @@ void NotebookTest::testLineArray()
   
 }
 
+void NotebookTest::testPolylinePath()
+{
+  QTest::keyClick(input, Qt::Key_A, Qt::ControlModifier);
+  QTest::keyClick(input, Qt::Key_Delete);
+  QTest::qWait(200);
+  QTest::keyClicks(input, "(make-polyline (list (make-point 0 0) (make-point 10 20) (make-point 20 0) (make-point 30 20)))");
+  QTest::qWait(200);
+  QTest::keyClick(input, Qt::Key_Return, Qt::ShiftModifier);
+  QTest::qWait(200);
+
+  // one path item for all three segments
+  QList<QGraphicsItem *> items = output->GScene->items();
+  QCOMPARE(items.size(), 1);
+  QCOMPARE(items[0]->type(), int(QGraphicsPathItem::Type));
+}
+
+void NotebookTest::testDensityRaster()
+{
+  QTest::keyClick(input, Qt::Key_A, Qt::ControlModifier);
+  QTest::keyClick(input, Qt::Key_Delete);
+  QTest::qWait(200);
+  QTest::keyClicks(input, "(density-plot (list (list -1 -1) (list 0 0.5) (list 1 1)) (list (list \"resolution\" 4)))");
+  QTest::qWait(200);
+  QTest::keyClick(input, Qt::Key_Return, Qt::ShiftModifier);
+  QTest::qWait(200);
+
+  // the cells are one image inside the frame
+  int images = 0;
+  foreach(auto item, output->GScene->items()) {
+    if (item->type() == QGraphicsPixmapItem::Type)
+      images += 1;
+  }
+  QCOMPARE(images, 1);
+}
+
 void NotebookTest::testTextSend()
 { 
   QTest::qSleep(200);
@@ -0,0 +1,110 @@
+#include "optimize.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "semantic_error.hpp"
+
+namespace {
+
+bool isPure(const std::string & s){
+  static const std::set<std::string> pure = {
+    "+", "-", "*", "/", "^", "sqrt", "ln", "sin", "cos", "tan",
+    "real", "imag", "mag", "arg", "conj", "<", ">", "=", "fsum", "min", "max"
+  };
+  return pure.count(s) != 0;
+}
+
+bool isConstantName(const std::string & s){
+  return (s == "e") || (s == "pi") || (s == "I");
+}
+
+bool isConstant(const Expression & exp){
+  return (exp.isHeadNumber() || exp.isHeadComplexNumber()) &&
+    (exp.tailConstBegin() == exp.tailConstEnd()) && exp.properties().empty();
+}
+
+// collect every name the program binds, these may shadow the built-ins
+void collectBound(const Expression & exp, std::set<std::string> & bound){
+
+  const Atom & head = exp.head();
+  auto first = exp.tailConstBegin();
+
+  if(first != exp.tailConstEnd()){
+    if(head.isSymbol() && head.asSymbol() == "define"){
+      bound.insert(first->head().asSymbol());
+    }
+    else if(head.isLambda() && head.asSymbol() == "lambda"){
+      bound.insert(first->head().asSymbol());
+      for(auto e = first->tailConstBegin(); e != first->tailConstEnd(); ++e){
+        bound.insert(e->head().asSymbol());
+      }
+    }
+  }
+
+  for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
+    collectBound(*e, bound);
+  }
+}
+
+Expression fold(const Expression & exp, const Environment & env, const std::set<std::string> & bound){
+
+  const Atom & head = exp.head();
+  const std::string name = head.asSymbol();
+
+  // a reference to a built-in constant
+  if(exp.tailConstBegin() == exp.tailConstEnd()){
+    if(head.isSymbol() && isConstantName(name) && !bound.count(name) && env.is_exp(head)){
+      Expression value = env.get_exp(head);
+      if(isConstant(value)){
+        return value;
+      }
+    }
+    return exp;
+  }
+
+  Expression result(head);
+  for(auto & property : exp.properties()){
+    result.setProperty(property.first, property.second);
+  }
+
+  // the binding forms name symbols rather than refer to them
+  auto e = exp.tailConstBegin();
+  if((head.isSymbol() && name == "define") || (head.isLambda() && name == "lambda")){
+    result.appendExpression(*e++);
+  }
+
+  bool constantArgs = true;
+  for(; e != exp.tailConstEnd(); ++e){
+    result.appendExpression(fold(*e, env, bound));
+    constantArgs = constantArgs && isConstant(*result.tail());
+  }
+
+  if(!constantArgs || !head.isSymbol() || !isPure(name) || bound.count(name) || !env.is_proc(head)){
+    return result;
+  }
+
+  std::vector<Expression> args(result.tailConstBegin(), result.tailConstEnd());
+  try{
+    Expression value = env.get_proc(head)(args);
+    if(isConstant(value)){
+      return value;
+    }
+  }
+  catch(const SemanticError &){
+    // leave the call in place so it fails when evaluated
+  }
+  return result;
+}
+
+} // namespace
+
+Expression optimize(const Expression & exp, const Environment & env){
+
+  std::set<std::string> bound;
+  collectBound(exp, bound);
+
+  return fold(exp, env, bound);
+}
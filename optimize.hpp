@@ -0,0 +1,31 @@
+/*! \file optimize.hpp
+Defines the constant folding pass run over a parsed program before evaluation.
+ */
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include "expression.hpp"
+
+// forward declare Environment
+class Environment;
+
+/*! \fn optimize
+\brief fold constant subexpressions of a program (abstract syntax tree)
+
+Calls to pure numeric built-in procedures (+, -, *, /, ^, fsum, min, max, sqrt,
+ln, sin, cos, tan, real, imag, mag, arg, conj, <, >, =) whose arguments are all
+constant are replaced by their value, and references to the constants e, pi
+and I are replaced by their value in env. Folding works bottom up, so nested
+constant expressions such as (* 270 (/ pi 180)) collapse to a single number.
+
+A name is never folded if the program binds it with define or as a lambda
+parameter, or if env no longer maps it to the built-in. A call that raises a
+SemanticError is left as written so the error is reported when it runs.
+
+\param exp the parsed program
+\param env the environment the program will be evaluated in
+\returns the folded program, which evaluates to the same result as exp
+ */
+Expression optimize(const Expression & exp, const Environment & env);
+
+#endif
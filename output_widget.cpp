@@ -1,4 +1,5 @@
 #include "output_widget.hpp"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -15,9 +16,8 @@
 //};
 //message_queue<expsNmsgs> outputMsgs;
 
-message_queue<std::string> inputMsgs;
-message_queue<Expression> outputMsgs;
-Interpreter interp;
+spsc_queue<std::string> inputMsgs;
+spsc_queue<Expression> outputMsgs;
 std::thread th1;
 bool threadOff = 0; // 0 for off, 1 for on
 
@@ -103,8 +103,11 @@ void OutputWidget::startThread() {
   }
 }
 void OutputWidget::resetThread() {
-  interp = new Interpreter();
+  // the kernel thread uses interp, stop it before dropping the environment
+  // (and with it any memoized results)
   stopThread();
+  delete interp;
+  interp = new Interpreter();
   startThread();
   /*if (threadOff) {
     th1 = std::thread(concurrent_tui_access, interp);
@@ -148,37 +151,53 @@ void concurrent_tui_access(Interpreter * interp)
         outputExp = Expression(Atom(oss.str().c_str()));
       }
     }
-    outputMsgs.push(outputExp);
+    // hand the result tree over without copying it
+    outputMsgs.push(std::move(outputExp));
   }
 }
 
-void OutputWidget::gval(Expression exp) {
+void OutputWidget::gval(const Expression & exp) {
 
-  if (exp.isTypePoint())
+  switch (exp.kind()) {
+  case GraphicKind::Point:
     handle_point(exp);
-  else if (exp.isTypeLine())
+    break;
+  case GraphicKind::Line:
     handle_line(exp);
-  else if (exp.isHeadList()) {
-    for (auto it = exp.tailConstBegin(); it < exp.tailConstEnd(); ++it) {
-      gval(*it);
+    break;
+  case GraphicKind::Text:
+    handle_text(exp);
+    break;
+  case GraphicKind::Polyline:
+    handle_polyline(exp);
+    break;
+  case GraphicKind::Raster:
+    handle_raster(exp);
+    break;
+  case GraphicKind::None:
+    if (exp.isHeadList()) {
+      for (auto it = exp.tailConstBegin(); it < exp.tailConstEnd(); ++it) {
+        gval(*it);
+      }
     }
+    else if (!exp.head().isLambda())
+      handle_text(exp);
+    break;
   }
-  else if (!exp.head().isLambda())
-    handle_text(exp);    
-  
+
   GView->fitInView(GScene->itemsBoundingRect(), Qt::KeepAspectRatio);
 }
 
-void OutputWidget::handle_text(Expression exp) {
+void OutputWidget::handle_text(const Expression & exp) {
   double x = 0, y = 0;
   double textScale = 1;
   double rotation = 0; //in rads
   QGraphicsItem * item;
   if (exp.isTypeText()){
-    if (exp.pList.find("\"position\"") != exp.pList.end()) 
+    if (exp.properties().find("\"position\"") != exp.properties().end()) 
     {
-      x = exp.pList.find("\"position\"")->second.tailConstBegin()->head().asNumber();
-      auto backit = exp.pList.find("\"position\"")->second.tailConstEnd() - 1;
+      x = exp.properties().find("\"position\"")->second.tailConstBegin()->head().asNumber();
+      auto backit = exp.properties().find("\"position\"")->second.tailConstEnd() - 1;
       y = backit->head().asNumber();
 
       QString text = exp.head().asSymbol().c_str();
@@ -186,14 +205,14 @@ void OutputWidget::handle_text(Expression exp) {
         text.remove(0, 1);
         text.remove(text.length() - 1, 1);
       }
-      if (exp.pList.find("\"text-scale\"") != exp.pList.end()) {
-        textScale = exp.pList.find("\"text-scale\"")->second.head().asNumber();
+      if (exp.properties().find("\"text-scale\"") != exp.properties().end()) {
+        textScale = exp.properties().find("\"text-scale\"")->second.head().asNumber();
         if (textScale <= 0) { 
           textScale = 1;
         }
       }
-      if (exp.pList.find("\"text-rotation\"") != exp.pList.end()) {
-        rotation = exp.pList.find("\"text-rotation\"")->second.head().asNumber()*180.0 / M_PI;
+      if (exp.properties().find("\"text-rotation\"") != exp.properties().end()) {
+        rotation = exp.properties().find("\"text-rotation\"")->second.head().asNumber()*180.0 / M_PI;
         if (rotation > 180)
           rotation = rotation - 360;
       }
@@ -239,9 +258,9 @@ void OutputWidget::resizeEvent(QResizeEvent * event)
     return;
 }
 
-void OutputWidget::handle_line(Expression exp) {
-  Expression pt1 = *(exp.tailConstBegin());
-  Expression pt2 = *(--exp.tailConstEnd());
+void OutputWidget::handle_line(const Expression & exp) {
+  const Expression & pt1 = *(exp.tailConstBegin());
+  const Expression & pt2 = *(--exp.tailConstEnd());
   qreal x1;
   qreal x2;
   qreal y1;
@@ -265,23 +284,23 @@ void OutputWidget::handle_line(Expression exp) {
     return;
   
   QPen pen;
-  if (exp.pList.find("\"thickness\"") != exp.pList.end())
+  if (exp.properties().find("\"thickness\"") != exp.properties().end())
   {
-    if (exp.pList.find("\"thickness\"")->second.head().asNumber() < 0) {
+    if (exp.properties().find("\"thickness\"")->second.head().asNumber() < 0) {
       GScene->addText("ERROR: thickness is not positive");  
       return;
     }
-    pen.setWidth(exp.pList.find("\"thickness\"")->second.head().asNumber());
+    pen.setWidth(exp.properties().find("\"thickness\"")->second.head().asNumber());
   }
   GScene->addLine(x1, y1, x2, y2, pen);
 }
 
-void OutputWidget::handle_point(Expression exp) 
+void OutputWidget::handle_point(const Expression & exp) 
 {
   double x = exp.tailConstBegin()->head().asNumber();
   auto backit = --exp.tailConstEnd();
   double y = backit->head().asNumber();
-  double width = exp.pList.find("\"size\"")->second.head().asNumber();
+  double width = exp.properties().find("\"size\"")->second.head().asNumber();
   
   if (width < 0) {
     GScene->addText("Error: point size not positive.");
@@ -297,4 +316,59 @@ void OutputWidget::handle_point(Expression exp)
   item->setBrush((Qt::black));
   item->setRect(rectangle);
   GScene->addItem(item);
-}
\ No newline at end of file
+}
+void OutputWidget::handle_polyline(const Expression & exp)
+{
+  if (!exp.packed() || exp.packed()->size() < 4)
+    return;
+  const std::vector<double> & xy = *exp.packed();
+
+  QPen pen;
+  if (exp.properties().find("\"thickness\"") != exp.properties().end())
+  {
+    if (exp.properties().find("\"thickness\"")->second.head().asNumber() < 0) {
+      GScene->addText("ERROR: thickness is not positive");
+      return;
+    }
+    pen.setWidth(exp.properties().find("\"thickness\"")->second.head().asNumber());
+  }
+
+  // one path item for the whole curve
+  QPainterPath path(QPointF(xy[0], xy[1]));
+  for (std::size_t i = 2; i + 1 < xy.size(); i += 2)
+    path.lineTo(xy[i], xy[i + 1]);
+  GScene->addPath(path, pen);
+}
+
+void OutputWidget::handle_raster(const Expression & exp)
+{
+  auto columns = exp.properties().find("\"columns\"");
+  auto position = exp.properties().find("\"position\"");
+  auto width = exp.properties().find("\"width\"");
+  auto height = exp.properties().find("\"height\"");
+  if (!exp.packed() || columns == exp.properties().end() || position == exp.properties().end() ||
+      width == exp.properties().end() || height == exp.properties().end())
+    return;
+
+  const std::vector<double> & cells = *exp.packed();
+  int ncolumns = int(columns->second.head().asNumber());
+  if (ncolumns <= 0 || cells.empty() || cells.size() % ncolumns != 0)
+    return;
+  int nrows = int(cells.size() / ncolumns);
+
+  // one image, empty cells white and the fullest black
+  double most = *std::max_element(cells.begin(), cells.end());
+  QImage image(ncolumns, nrows, QImage::Format_RGB32);
+  for (int r = 0; r < nrows; ++r) {
+    for (int c = 0; c < ncolumns; ++c) {
+      int shade = 255 - int(most > 0 ? 255 * cells[r * ncolumns + c] / most : 0);
+      image.setPixel(c, r, qRgb(shade, shade, shade));
+    }
+  }
+
+  QGraphicsPixmapItem * item = GScene->addPixmap(QPixmap::fromImage(image));
+  item->setPos(position->second.tailConstBegin()->head().asNumber(),
+               (position->second.tailConstEnd() - 1)->head().asNumber());
+  item->setTransform(QTransform::fromScale(width->second.head().asNumber() / ncolumns,
+                                           height->second.head().asNumber() / nrows));
+}
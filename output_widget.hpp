@@ -6,6 +6,9 @@
 #include <QVBoxLayout>
 
 #include <QGraphicsEllipseItem>
+#include <QPainterPath>
+#include <QImage>
+#include <QTransform>
 #include <QDebug>
 #include <QList>
 #include <QVector>
@@ -17,7 +20,7 @@
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
 #include "startup_config.hpp"
-#include "message_queue.h"
+#include "spsc_queue.h"
 
 
 class OutputWidget : public QWidget {
@@ -39,10 +42,12 @@ public:
   void startThread();
   void resetThread();
   void stopThread();
-  void gval(Expression exp);
-  void handle_point(Expression exp);
-  void handle_line(Expression exp);
-  void handle_text(Expression exp);
+  void gval(const Expression & exp);
+  void handle_point(const Expression & exp);
+  void handle_line(const Expression & exp);
+  void handle_text(const Expression & exp);
+  void handle_polyline(const Expression & exp);
+  void handle_raster(const Expression & exp);
   void resizeEvent(QResizeEvent *event);
 
 };
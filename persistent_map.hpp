@@ -0,0 +1,218 @@
+/*! \file persistent_map.hpp
+Defines the persistent hash trie the environment stores its definitions in.
+ */
+#ifndef PERSISTENT_MAP_HPP
+#define PERSISTENT_MAP_HPP
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*! \class PersistentMap
+\brief A map from strings to values whose versions share structure.
+
+The map is a hash array mapped trie: each branch node consumes five bits of
+the key's hash and keeps only the children it uses, and each leaf holds the
+entries whose keys have the same hash. Nodes are never modified once built.
+Adding an entry copies the nodes on the path to it and then makes the new
+root current, so an older version stays valid for as long as a copy of the
+map refers to it.
+
+Copying a map is O(1). Writes go through the map that owns a version; other
+threads may read it (find, forEach) or copy it (snapshot) at the same time.
+Each read loads the current root atomically and holds it for its whole walk,
+so it sees one version, never waits for a writer, and the nodes it walks
+stay alive even if a write replaces them meanwhile.
+ */
+template<typename T>
+class PersistentMap {
+public:
+
+  /*! The value of key, or nullptr if the map has no entry for it. The value
+      stays valid until the map drops the version it was found in, i.e. until
+      the next write to this map, or for as long as a snapshot holds it.
+   */
+  const T * find(const std::string & key) const {
+
+    const std::size_t hash = std::hash<std::string>()(key);
+    const NodePtr root = std::atomic_load(&m_root);
+    const Node * node = root.get();
+    for(unsigned shift = 0; node != nullptr; shift += bits){
+      if(node->leaf){
+	if(node->hash != hash){
+	  return nullptr;
+	}
+	for(auto & entry : node->entries){
+	  if(entry.first == key){
+	    return &entry.second;
+	  }
+	}
+	return nullptr;
+      }
+
+      std::uint32_t bit = slotBit(hash, shift);
+      if((node->bitmap & bit) == 0){
+	return nullptr;
+      }
+      node = node->children[index(node->bitmap, bit)].get();
+    }
+    return nullptr;
+  }
+
+  /// map key to value, replacing any entry it has
+  void assign(const std::string & key, T value){
+    insert(key, std::move(value), true);
+  }
+
+  /// map key to value unless it has an entry, returns true if it was added
+  bool emplace(const std::string & key, T value){
+    return insert(key, std::move(value), false);
+  }
+
+  /// remove every entry
+  void clear(){
+    std::atomic_store(&m_root, std::shared_ptr<const Node>());
+  }
+
+  /// call f(key, value) for every entry, in no particular order
+  template<typename F>
+  void forEach(F f) const {
+    const NodePtr root = std::atomic_load(&m_root);
+    visit(root.get(), f);
+  }
+
+  /// a copy of the current version, safe to take while another thread writes
+  PersistentMap snapshot() const {
+    PersistentMap result;
+    result.m_root = std::atomic_load(&m_root);
+    return result;
+  }
+
+private:
+
+  // hash bits consumed per level, and the slots of a branch
+  static const unsigned bits = 5;
+
+  struct Node {
+    // a leaf holds every entry whose key hashes to hash
+    bool leaf;
+    std::size_t hash;
+    std::vector<std::pair<std::string, T>> entries;
+
+    // a branch holds one child per set bit of bitmap, in slot order
+    std::uint32_t bitmap;
+    std::vector<std::shared_ptr<const Node>> children;
+  };
+
+  typedef std::shared_ptr<const Node> NodePtr;
+
+  NodePtr m_root;
+
+  static std::uint32_t slotBit(std::size_t hash, unsigned shift){
+    // past the last level every key lands in slot 0, the leaves tell them apart
+    unsigned slot = (shift < 8 * sizeof(std::size_t)) ? (hash >> shift) & 31 : 0;
+    return std::uint32_t(1) << slot;
+  }
+
+  static std::size_t index(std::uint32_t bitmap, std::uint32_t bit){
+    return std::bitset<32>(bitmap & (bit - 1)).count();
+  }
+
+  static NodePtr makeLeaf(std::size_t hash, const std::string & key, T && value){
+    std::shared_ptr<Node> leaf = std::make_shared<Node>();
+    leaf->leaf = true;
+    leaf->hash = hash;
+    leaf->bitmap = 0;
+    leaf->entries.emplace_back(key, std::move(value));
+    return leaf;
+  }
+
+  bool insert(const std::string & key, T && value, bool replace){
+
+    // only the owner writes, so its own plain read of the root is current
+    bool added = false;
+    NodePtr root = insert(m_root, 0, std::hash<std::string>()(key), key, value, replace, added);
+    if(root != m_root){
+      // publish the new version, snapshots keep the old one
+      std::atomic_store(&m_root, std::move(root));
+    }
+    return added;
+  }
+
+  // the node that replaces node once key is added below it
+  static NodePtr insert(const NodePtr & node, unsigned shift, std::size_t hash,
+			const std::string & key, T & value, bool replace, bool & added){
+
+    if(!node){
+      added = true;
+      return makeLeaf(hash, key, std::move(value));
+    }
+
+    if(node->leaf && node->hash == hash){
+      std::shared_ptr<Node> leaf = std::make_shared<Node>(*node);
+      for(auto & entry : leaf->entries){
+	if(entry.first == key){
+	  if(!replace){
+	    return node;
+	  }
+	  entry.second = std::move(value);
+	  return leaf;
+	}
+      }
+      added = true;
+      leaf->entries.emplace_back(key, std::move(value));
+      return leaf;
+    }
+
+    std::shared_ptr<Node> branch = std::make_shared<Node>();
+    branch->leaf = false;
+    branch->hash = 0;
+    if(node->leaf){
+      // a leaf in the way moves one level down
+      branch->bitmap = slotBit(node->hash, shift);
+      branch->children.push_back(node);
+    }
+    else{
+      branch->bitmap = node->bitmap;
+      branch->children = node->children;
+    }
+
+    std::uint32_t bit = slotBit(hash, shift);
+    std::size_t i = index(branch->bitmap, bit);
+    if(branch->bitmap & bit){
+      NodePtr child = insert(branch->children[i], shift + bits, hash, key, value, replace, added);
+      if(child == branch->children[i] && !node->leaf){
+	return node;
+      }
+      branch->children[i] = std::move(child);
+    }
+    else{
+      added = true;
+      branch->bitmap |= bit;
+      branch->children.insert(branch->children.begin() + i, makeLeaf(hash, key, std::move(value)));
+    }
+    return branch;
+  }
+
+  template<typename F>
+  static void visit(const Node * node, F & f){
+    if(node == nullptr){
+      return;
+    }
+    if(node->leaf){
+      for(auto & entry : node->entries){
+	f(entry.first, entry.second);
+      }
+      return;
+    }
+    for(auto & child : node->children){
+      visit(child.get(), f);
+    }
+  }
+};
+
+#endif
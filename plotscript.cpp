@@ -3,11 +3,14 @@
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <chrono>
+#include <atomic>
+#include <utility>
 
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
 #include "startup_config.hpp"
-#include "message_queue.h"
+#include "spsc_queue.h"
 #include <csignal>
 #include <cstdlib>
 
@@ -17,7 +20,9 @@ using namespace std;
 // and the rest of the code. This atomic integer counts the number of times
 // Cntl-C has been pressed by not reset by the REPL code.
 volatile sig_atomic_t global_status_flag = 0;
-message_queue<bool> * interruptQ;
+// Raised by the signal handler to interrupt the running evaluation. Raising
+// it is a lock-free atomic store, which is safe in signal context.
+CancelToken interruptToken;
 
 // *****************************************************************************
 // install a signal handler for Cntl-C on Windows
@@ -35,7 +40,7 @@ BOOL WINAPI interrupt_handler(DWORD fdwCtrlType) {
       exit(EXIT_FAILURE);
     }
     ++global_status_flag;
-    interruptQ->push(bool(true));
+    interruptToken.cancel();
     return TRUE;
 
   default:
@@ -64,7 +69,7 @@ void interrupt_handler(int signal_num) {
       exit(EXIT_FAILURE);
     }
     ++global_status_flag;
-    interruptQ->push(bool(true));
+    interruptToken.cancel();
   }
 }
 
@@ -89,8 +94,29 @@ struct expsNmsgs
   bool msgPresent;
 };
 
-void threaded_interp(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp);
-void repl(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff);
+// a line for the kernel thread, stamped so it can measure how long it took to wake
+struct kernelRequest
+{
+  std::string text;
+  std::chrono::steady_clock::time_point sent;
+};
+
+kernelRequest request(const std::string & text) {
+  return kernelRequest{text, std::chrono::steady_clock::now()};
+}
+
+// Time from a request being sent to the kernel thread picking it up, in
+// microseconds. Written by the kernel thread, read by %latency in the REPL.
+struct wakeStats
+{
+  std::atomic<unsigned long> count{0};
+  std::atomic<unsigned long long> last{0};
+  std::atomic<unsigned long long> total{0};
+  std::atomic<unsigned long long> max{0};
+} wakeLatency;
+
+void threaded_interp(spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp);
+void repl(spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff);
 
 void prompt() {
   std::cout << "\nplotscript> ";
@@ -111,7 +137,7 @@ void info(const std::string & err_str) {
   std::cout << "Info: " << err_str << std::endl;
 }
 
-int eval_from_stream(std::istream & stream, std::string filename, message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
+int eval_from_stream(std::istream & stream, std::string filename, spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
 
   if (!interp->parseStream(stream)) {
     error("Invalid Program. Could not parse.");
@@ -119,7 +145,7 @@ int eval_from_stream(std::istream & stream, std::string filename, message_queue<
   }
   else {
     try {
-      Expression exp = interp->evaluate(interruptQ, false);
+      Expression exp = interp->evaluate(&interruptToken);
       std::cout << exp << std::endl;
     }
     catch (const SemanticError & ex) {
@@ -134,7 +160,7 @@ int eval_from_stream(std::istream & stream, std::string filename, message_queue<
   return 0;
 }
 
-int eval_from_file(std::string filename, message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
+int eval_from_file(std::string filename, spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
 
   std::ifstream ifs(filename);
 
@@ -146,7 +172,7 @@ int eval_from_file(std::string filename, message_queue<std::string> * inputMsgs,
   return eval_from_stream(ifs, filename, inputMsgs, outputMsgs, interp, th1, threadOff);
 }
 
-int eval_from_command(std::string argexp, message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
+int eval_from_command(std::string argexp, spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
 
   std::istringstream expression(argexp);
 
@@ -156,10 +182,32 @@ int eval_from_command(std::string argexp, message_queue<std::string> * inputMsgs
 
 int main(int argc, char *argv[])
 {
-  message_queue<std::string> * inputMsgs = new message_queue<std::string>();
-  message_queue<expsNmsgs> * outputMsgs = new message_queue<expsNmsgs>();
-  interruptQ = new message_queue<bool>();
-  Interpreter * interp = new Interpreter();
+  spsc_queue<kernelRequest> * inputMsgs = new spsc_queue<kernelRequest>();
+  spsc_queue<expsNmsgs> * outputMsgs = new spsc_queue<expsNmsgs>();
+
+  // leading options: -d dumps each program after constant folding, before it
+  // is evaluated, and -j N sets the number of threads for parallel builtins
+  bool dump = false;
+  std::size_t workers = ThreadPool::defaultWorkers();
+  while (argc > 1) {
+    std::string option(argv[1]);
+    if (option == "-d") {
+      dump = true;
+      --argc;
+      ++argv;
+    }
+    else if (option == "-j" && argc > 2) {
+      workers = std::strtoul(argv[2], nullptr, 10);
+      argc -= 2;
+      argv += 2;
+    }
+    else
+      break;
+  }
+
+  Interpreter * interp = new Interpreter(workers);
+  if (dump)
+    interp->dumpOptimized(&std::cerr);
   std::thread th1(threaded_interp, inputMsgs, outputMsgs, interp);
   bool threadOff = 0;
 
@@ -187,33 +235,41 @@ int main(int argc, char *argv[])
 end:
   if (!threadOff)
   {
-    inputMsgs->push("EXIT_LOOP_");
+    inputMsgs->push(request("EXIT_LOOP_"));
     th1.join();
   }
   delete interp;
   delete inputMsgs;
   delete outputMsgs;
-  delete interruptQ;
 
   return EXIT_SUCCESS;
 }
 
-void threaded_interp(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp)
+void threaded_interp(spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp)
 {
-  std::string msg;
+  kernelRequest msg;
   expsNmsgs outputMsg;
   while (1)
   {
-    bool x;
-    while (interruptQ->try_pop(x))
-      x = 0;
-
-    if (inputMsgs->try_pop(msg))
+    // sleep until the REPL sends something, interrupts only matter while
+    // evaluating and are carried by interruptToken
+    inputMsgs->wait_and_pop(msg);
     {
-      if (msg == "EXIT_LOOP_")
+      unsigned long long waited = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - msg.sent).count();
+      wakeLatency.last = waited;
+      wakeLatency.total += waited;
+      if (waited > wakeLatency.max)
+        wakeLatency.max = waited;
+      ++wakeLatency.count;
+
+      if (msg.text == "EXIT_LOOP_")
         return;
 
-      std::istringstream expression(msg);
+      // an interrupt while idle does not carry over to this message
+      interruptToken.reset();
+
+      std::istringstream expression(msg.text);
 
       if (!interp->parseStream(expression)) {
         //error("Invalid Expression. Could not parse.");
@@ -223,7 +279,7 @@ void threaded_interp(message_queue<std::string> * inputMsgs, message_queue<expsN
       }
       else {
         try {
-          outputMsg.exp = interp->evaluate(interruptQ,false);
+          outputMsg.exp = interp->evaluate(&interruptToken);
           outputMsg.msgPresent = 0;
         }
         catch (const SemanticError & ex) {
@@ -233,13 +289,14 @@ void threaded_interp(message_queue<std::string> * inputMsgs, message_queue<expsN
           outputMsg.msgPresent = 1;
         }
       }
-      outputMsgs->push(outputMsg);
+      // hand the result tree over without copying it
+      outputMsgs->push(std::move(outputMsg));
     }
   }
 }
 
 // A REPL is a repeated read-eval-print loop
-void repl(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
+void repl(spsc_queue<kernelRequest> * inputMsgs, spsc_queue<expsNmsgs> * outputMsgs, Interpreter * interp, thread & th1, bool threadOff) {
 
   while (1) {
     global_status_flag = 0;
@@ -263,16 +320,30 @@ void repl(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * out
     }
     else if (line == "%stop") {
       if (!threadOff) {
-        inputMsgs->push("EXIT_LOOP_");
+        inputMsgs->push(request("EXIT_LOOP_"));
         th1.join();
         threadOff = 1;
       }
     }
+    else if (line == "%latency") {
+      unsigned long count = wakeLatency.count;
+      if (count == 0)
+        info("kernel wake-up latency: no requests yet");
+      else
+        info("kernel wake-up latency: last " + std::to_string(wakeLatency.last) +
+             " us, mean " + std::to_string(wakeLatency.total / count) +
+             " us, max " + std::to_string(wakeLatency.max) + " us over " +
+             std::to_string(count) + " requests");
+    }
     else if (line == "%reset") {
-      if (threadOff)
-        th1 = thread(threaded_interp, inputMsgs, outputMsgs, interp);
-      delete interp;
-      interp = new Interpreter();
+      // the kernel thread uses interp, stop it before dropping the environment
+      // (and with it any memoized results)
+      if (!threadOff) {
+        inputMsgs->push(request("EXIT_LOOP_"));
+        th1.join();
+      }
+      interp->reset();
+      th1 = thread(threaded_interp, inputMsgs, outputMsgs, interp);
       threadOff = 0;
     }
     else
@@ -281,7 +352,7 @@ void repl(message_queue<std::string> * inputMsgs, message_queue<expsNmsgs> * out
         error("Error: interpreter kernel not running");
       else
       {
-        inputMsgs->push(line);
+        inputMsgs->push(request(line));
         expsNmsgs msg;
         outputMsgs->wait_and_pop(msg);
         if (!msg.msgPresent)
@@ -0,0 +1,73 @@
+// Compares the round-trip latency of message_queue and spsc_queue.
+//
+// A client thread sends a request and waits for the reply, the way the REPL
+// talks to the kernel thread, and the time of each round trip is recorded.
+// Usage: queue_benchmark [round-trips]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "message_queue.h"
+#include "spsc_queue.h"
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename Queue>
+std::vector<double> round_trips(std::size_t count)
+{
+  Queue requests;
+  Queue replies;
+
+  std::thread kernel([&requests, &replies, count]() {
+    std::string msg;
+    for (std::size_t i = 0; i < count; ++i) {
+      requests.wait_and_pop(msg);
+      replies.push(msg);
+    }
+  });
+
+  std::vector<double> times;
+  times.reserve(count);
+  std::string msg = "(+ 1 2)";
+  for (std::size_t i = 0; i < count; ++i) {
+    Clock::time_point start = Clock::now();
+    requests.push(msg);
+    replies.wait_and_pop(msg);
+    times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+  }
+
+  kernel.join();
+  std::sort(times.begin(), times.end());
+  return times;
+}
+
+void report(const std::string & name, const std::vector<double> & times)
+{
+  double total = 0;
+  for (double t : times)
+    total += t;
+
+  std::cout << name
+            << ": mean " << total / times.size() << " us"
+            << ", p50 " << times[times.size() / 2] << " us"
+            << ", p99 " << times[times.size() * 99 / 100] << " us"
+            << ", max " << times.back() << " us" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  std::size_t count = 20000;
+  if (argc == 2)
+    count = std::max(1, std::atoi(argv[1]));
+
+  std::cout << count << " round trips" << std::endl;
+  report("message_queue", round_trips<message_queue<std::string>>(count));
+  report("spsc_queue   ", round_trips<spsc_queue<std::string>>(count));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*! \file reduce.hpp
+Defines the deterministic chunked reduction used by the m-ary arithmetic
+procedures, and the per-task accumulation used to count into bins.
+ */
+#ifndef REDUCE_HPP
+#define REDUCE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+#include "environment.hpp"
+#include "thread_pool.hpp"
+
+/// the number of arguments reduced sequentially as one piece
+const std::size_t reduceChunk = 4096;
+
+/*! \fn reduce
+\brief reduce the arguments in fixed chunks combined by a fixed tree
+
+The arguments are cut into chunks of reduceChunk, each chunk is reduced in
+order by chunk, and the partial results are combined pairwise, neighbour with
+neighbour, until one is left. The chunks and the tree depend only on the
+number of arguments, so the result is the same however many threads take part
+and whether or not the chunks run in parallel; with at most one chunk it is a
+plain left to right reduction.
+
+When the calling thread has a current ThreadPool with more than one worker
+the chunks are reduced on it.
+
+\param args the arguments to reduce
+\param chunk reduces a view of consecutive arguments to a Partial
+\param combine merges the Partials of two neighbouring ranges, left first
+\returns the Partial of all arguments
+ */
+template<typename Partial, typename Chunk, typename Combine>
+Partial reduce(Arguments args, Chunk chunk, Combine combine){
+
+  const std::size_t n = args.size();
+  const std::size_t chunks = (n + reduceChunk - 1) / reduceChunk;
+  if(chunks <= 1){
+    return chunk(args);
+  }
+
+  auto piece = [&args, n, &chunk](std::size_t i){
+    std::size_t first = i * reduceChunk;
+    std::size_t count = std::min(reduceChunk, n - first);
+    return chunk(Arguments(args.begin() + first, count));
+  };
+
+  std::vector<Partial> partials;
+  partials.reserve(chunks);
+
+  ThreadPool * pool = ThreadPool::current();
+  if(pool != nullptr && pool->size() > 1){
+    // a contiguous run of chunks per worker, they only fill their own slots
+    partials.resize(chunks);
+    std::size_t tasks = std::min(pool->size(), chunks);
+    std::vector<std::future<void>> done;
+    for(std::size_t t = 0; t < tasks; ++t){
+      std::size_t first = chunks * t / tasks;
+      std::size_t last = chunks * (t + 1) / tasks;
+      done.push_back(pool->submit([&partials, &piece, first, last](){
+	    for(std::size_t i = first; i < last; ++i){
+	      partials[i] = piece(i);
+	    }
+	  }));
+    }
+
+    // let every task finish before an error leaves this frame
+    std::exception_ptr error;
+    for(auto & d : done){
+      try{
+	pool->wait(d);
+      }
+      catch(...){
+	if(!error) error = std::current_exception();
+      }
+    }
+    if(error){
+      std::rethrow_exception(error);
+    }
+  }
+  else{
+    for(std::size_t i = 0; i < chunks; ++i){
+      partials.push_back(piece(i));
+    }
+  }
+
+  // combine neighbours level by level, an odd one out moves up unchanged
+  while(partials.size() > 1){
+    std::size_t half = 0;
+    for(std::size_t i = 0; i + 1 < partials.size(); i += 2){
+      partials[half++] = combine(partials[i], partials[i + 1]);
+    }
+    if(partials.size() % 2 == 1){
+      partials[half++] = partials.back();
+    }
+    partials.resize(half);
+  }
+  return partials.front();
+}
+
+/*! \fn accumulate
+\brief fold the arguments into one Partial per task and merge those
+
+For Partials that are large and cheap to add to, such as a grid of counts,
+where reduce would hold one per chunk. When the calling thread has a current
+ThreadPool with more than one worker and there is more than one chunk of
+arguments, each worker folds a contiguous run of them into its own copy of
+empty; otherwise one copy takes all of them. The copies are merged in order
+into the first, so at most one Partial per worker is alive at a time. The
+result only matches a sequential fold exactly when merge is exact, as for
+counts.
+
+\param args the arguments to fold
+\param empty the Partial each task starts from
+\param fold adds a view of consecutive arguments to a Partial
+\param merge adds the second Partial, of later arguments, into the first
+\returns the Partial of all arguments
+ */
+template<typename Partial, typename Fold, typename Merge>
+Partial accumulate(Arguments args, const Partial & empty, Fold fold, Merge merge){
+
+  const std::size_t n = args.size();
+  const std::size_t chunks = (n + reduceChunk - 1) / reduceChunk;
+  ThreadPool * pool = ThreadPool::current();
+  const std::size_t tasks = (pool == nullptr) ? 1 : std::min(pool->size(), chunks);
+  if(tasks <= 1){
+    Partial all(empty);
+    fold(all, args);
+    return all;
+  }
+
+  std::vector<Partial> partials(tasks, empty);
+  std::vector<std::future<void>> done;
+  for(std::size_t t = 0; t < tasks; ++t){
+    std::size_t first = n * t / tasks;
+    std::size_t last = n * (t + 1) / tasks;
+    done.push_back(pool->submit([&partials, &fold, &args, t, first, last](){
+	  fold(partials[t], Arguments(args.begin() + first, last - first));
+	}));
+  }
+
+  // let every task finish before an error leaves this frame
+  std::exception_ptr error;
+  for(auto & d : done){
+    try{
+      pool->wait(d);
+    }
+    catch(...){
+      if(!error) error = std::current_exception();
+    }
+  }
+  if(error){
+    std::rethrow_exception(error);
+  }
+
+  for(std::size_t t = 1; t < tasks; ++t){
+    merge(partials[0], partials[t]);
+  }
+  return partials[0];
+}
+
+#endif
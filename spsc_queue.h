@@ -0,0 +1,179 @@
+/* A bounded single-producer/single-consumer ring buffer with the same
+interface as message_queue. Push and pop are lock-free while the queue is
+neither empty nor full; only a consumer waiting on an empty queue (or a
+producer waiting on a full one) falls back to a mutex and condition variable.
+
+Exactly one thread may push and exactly one thread may pop at a time. The
+roles may move to other threads if the hand-over is synchronized, e.g. by
+joining the old thread before starting the new one.
+*/
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+
+template<typename MessageType, std::size_t Capacity = 64>
+class spsc_queue
+{
+ public:
+
+  spsc_queue() : the_head(0), the_tail(0), consumer_waiting(false), producer_waiting(false) {}
+
+  spsc_queue(const spsc_queue &) = delete;
+  spsc_queue & operator=(const spsc_queue &) = delete;
+
+  void push(MessageType const& message)
+  {
+    MessageType copy(message);
+    push(std::move(copy));
+  }
+
+  void push(MessageType&& message)
+  {
+    std::size_t tail = the_tail.load(std::memory_order_relaxed);
+    wait_for_space(tail, 1);
+    the_buffer[tail % Capacity] = std::move(message);
+    publish(tail + 1);
+  }
+
+  // push [first, last) in order, publishing each run that fits at once
+  template<typename InputIt>
+  void push_batch(InputIt first, InputIt last)
+  {
+    std::size_t tail = the_tail.load(std::memory_order_relaxed);
+    while(first != last)
+      {
+	std::size_t room = wait_for_space(tail, 1);
+	for(; room > 0 && first != last; --room, ++first, ++tail)
+	  {
+	    the_buffer[tail % Capacity] = std::move(*first);
+	  }
+	publish(tail);
+      }
+  }
+
+  bool empty() const
+  {
+    return the_head.load(std::memory_order_acquire) == the_tail.load(std::memory_order_acquire);
+  }
+
+  bool try_pop(MessageType& popped_value)
+  {
+    std::size_t head = the_head.load(std::memory_order_relaxed);
+    if(head == the_tail.load(std::memory_order_acquire))
+      {
+	return false;
+      }
+
+    popped_value = std::move(the_buffer[head % Capacity]);
+    release(head + 1);
+    return true;
+  }
+
+  // pop up to max messages into out, returns how many were popped
+  template<typename OutputIt>
+  std::size_t try_pop_batch(OutputIt out, std::size_t max)
+  {
+    std::size_t head = the_head.load(std::memory_order_relaxed);
+    std::size_t available = the_tail.load(std::memory_order_acquire) - head;
+    std::size_t count = (available < max) ? available : max;
+    if(count == 0)
+      {
+	return 0;
+      }
+
+    for(std::size_t i = 0; i < count; ++i, ++out)
+      {
+	*out = std::move(the_buffer[(head + i) % Capacity]);
+      }
+    release(head + count);
+    return count;
+  }
+
+  void wait_and_pop(MessageType& popped_value)
+  {
+    while(!try_pop(popped_value))
+      {
+	std::size_t head = the_head.load(std::memory_order_relaxed);
+	block_until([this, head]() { return the_tail.load() != head; }, consumer_waiting, not_empty);
+      }
+  }
+
+ private:
+
+  // spins this many times before blocking, a reply usually arrives within it
+  static const int spin_limit = 64;
+
+  std::array<MessageType, Capacity> the_buffer;
+
+  // monotonically increasing positions, slot = position % Capacity; padded
+  // apart so the producer and consumer do not share a cache line
+  std::atomic<std::size_t> the_head;
+  char head_padding[64];
+  std::atomic<std::size_t> the_tail;
+  char tail_padding[64];
+
+  std::atomic<bool> consumer_waiting;
+  std::atomic<bool> producer_waiting;
+  std::mutex the_mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+
+  // returns the number of free slots, at least needed, blocking until there are
+  std::size_t wait_for_space(std::size_t tail, std::size_t needed)
+  {
+    std::size_t room = Capacity - (tail - the_head.load(std::memory_order_acquire));
+    while(room < needed)
+      {
+	block_until([this, tail, needed]() { return Capacity - (tail - the_head.load()) >= needed; },
+		    producer_waiting, not_full);
+	room = Capacity - (tail - the_head.load(std::memory_order_acquire));
+      }
+    return room;
+  }
+
+  void publish(std::size_t tail)
+  {
+    the_tail.store(tail);
+    wake(consumer_waiting, not_empty);
+  }
+
+  void release(std::size_t head)
+  {
+    the_head.store(head);
+    wake(producer_waiting, not_full);
+  }
+
+  // the flag is set (sequentially consistent) before the final check of ready
+  // and read after the position is stored, so one side always sees the other
+  template<typename Predicate>
+  void block_until(Predicate ready, std::atomic<bool> & waiting, std::condition_variable & cv)
+  {
+    for(int i = 0; i < spin_limit; ++i)
+      {
+	if(ready()) return;
+	std::this_thread::yield();
+      }
+
+    std::unique_lock<std::mutex> lock(the_mutex);
+    waiting.store(true);
+    while(!ready())
+      {
+	cv.wait(lock);
+      }
+    waiting.store(false);
+  }
+
+  void wake(std::atomic<bool> & waiting, std::condition_variable & cv)
+  {
+    if(waiting.load())
+      {
+	std::lock_guard<std::mutex> lock(the_mutex);
+	cv.notify_one();
+      }
+  }
+};
@@ -0,0 +1,155 @@
+#include "thread_pool.hpp"
+
+namespace {
+
+// the pool made current on this thread (see Scope), or the one it works for
+thread_local ThreadPool * currentPool = nullptr;
+
+// the pool this thread is a worker of, and its index there
+thread_local ThreadPool * workerPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+
+} // namespace
+
+std::size_t ThreadPool::defaultWorkers() noexcept{
+  std::size_t n = std::thread::hardware_concurrency();
+  return (n == 0) ? 1 : n;
+}
+
+ThreadPool::ThreadPool(std::size_t workers): m_pending(0), m_stop(false), m_next(0){
+
+  for(std::size_t i = 0; i < workers; ++i){
+    m_workers.emplace_back(new Worker);
+  }
+}
+
+void ThreadPool::start(){
+  for(std::size_t i = 0; i < m_workers.size(); ++i){
+    m_threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+
+  // a pool never used never starts, and this sees the threads if it did
+  std::call_once(m_started, [](){});
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+
+  for(auto & t : m_threads){
+    t.join();
+  }
+}
+
+std::size_t ThreadPool::size() const noexcept{
+  return m_workers.size();
+}
+
+ThreadPool * ThreadPool::current() noexcept{
+  return currentPool;
+}
+
+ThreadPool::Scope::Scope(ThreadPool * pool) noexcept: m_previous(currentPool){
+  currentPool = pool;
+}
+
+ThreadPool::Scope::~Scope(){
+  currentPool = m_previous;
+}
+
+void ThreadPool::push(Task task){
+
+  std::call_once(m_started, &ThreadPool::start, this);
+
+  // workers keep their own tasks, everyone else deals them out
+  std::size_t index = (workerPool == this) ?
+    currentWorker : (m_next++ % m_workers.size());
+
+  {
+    // counted first so the count never drops below the queued tasks, and
+    // under the lock so a worker about to sleep sees it
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_pending;
+  }
+
+  {
+    Worker & worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+  m_wake.notify_one();
+}
+
+bool ThreadPool::take(std::size_t first, Task & task){
+
+  const std::size_t n = m_workers.size();
+
+  // the newest task of the first deque, it is most likely still in cache
+  {
+    Worker & worker = *m_workers[first];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(!worker.tasks.empty()){
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      --m_pending;
+      return true;
+    }
+  }
+
+  // else steal the oldest task of another deque
+  for(std::size_t i = 1; i < n; ++i){
+    Worker & victim = *m_workers[(first + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(!victim.tasks.empty()){
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --m_pending;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ThreadPool::runPendingTask(){
+
+  if(m_workers.empty() || m_pending == 0){
+    return false;
+  }
+
+  Task task;
+  std::size_t first = (workerPool == this) ? currentWorker : 0;
+  if(!take(first, task)){
+    return false;
+  }
+
+  // tasks always see the pool they run for
+  Scope scope(this);
+  task();
+  return true;
+}
+
+void ThreadPool::work(std::size_t index){
+
+  currentPool = this;
+  workerPool = this;
+  currentWorker = index;
+
+  Task task;
+  while(true){
+    if(take(index, task)){
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.wait(lock, [this](){ return m_stop || m_pending > 0; });
+    if(m_stop && m_pending == 0){
+      return;
+    }
+  }
+}
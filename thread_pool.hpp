@@ -0,0 +1,181 @@
+/*! \file thread_pool.hpp
+Defines the work-stealing thread pool the interpreter runs parallel work on.
+ */
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cancel_token.hpp"
+#include "semantic_error.hpp"
+
+/*! \class ThreadPool
+\brief A fixed set of worker threads that run submitted tasks.
+
+Each worker owns a deque of tasks. A worker pushes the tasks it submits
+itself on the back of its own deque and takes work from the back, so nested
+parallel work stays on the worker that created it; an idle worker steals
+from the front of the other deques. Tasks submitted from outside the pool
+are dealt round-robin.
+
+A thread that waits for a task with wait runs other pending tasks meanwhile,
+so tasks may themselves submit and wait for tasks without deadlocking.
+
+A pool with no workers runs each task immediately inside submit. The worker
+threads start with the first task queued, so a pool that is never used costs
+no threads.
+ */
+class ThreadPool {
+public:
+
+  /// one worker per hardware thread
+  static std::size_t defaultWorkers() noexcept;
+
+  /// make room for the given number of workers, started on first use
+  explicit ThreadPool(std::size_t workers = defaultWorkers());
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  /// run the tasks still queued, then stop the workers
+  ~ThreadPool();
+
+  /// the number of worker threads, started or not
+  std::size_t size() const noexcept;
+
+  /*! Queue a task to run on a worker.
+    \param task the callable to run, taking no arguments
+    \param cancel when raised before the task starts, the task is skipped and
+    its future holds the SemanticError for an interrupt; may be nullptr
+    \return a future holding the result or the exception the task threw
+   */
+  template<typename F>
+  std::future<typename std::result_of<F()>::type> submit(F task, const CancelToken * cancel = nullptr);
+
+  /*! Wait for a future of a task of this pool, running other pending tasks
+      until it is ready.
+    \return the result of the task
+    \throws what the task threw
+   */
+  template<typename T>
+  T wait(std::future<T> & result);
+
+  /// as wait, for a future that may be waited for more than once
+  template<typename T>
+  const T & wait(const std::shared_future<T> & result);
+
+  /// run one pending task on the calling thread, false if there was none
+  bool runPendingTask();
+
+  /// the pool the calling thread is a worker of or was made current on (see Scope)
+  static ThreadPool * current() noexcept;
+
+  /*! \class Scope
+  \brief Makes a pool current on this thread for its lifetime.
+   */
+  class Scope {
+  public:
+    explicit Scope(ThreadPool * pool) noexcept;
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+
+  private:
+    ThreadPool * m_previous;
+  };
+
+private:
+
+  typedef std::function<void()> Task;
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::thread> m_threads;
+
+  // tasks queued but not yet taken, idle workers sleep while it is zero
+  std::atomic<std::size_t> m_pending;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop;
+
+  // the deque the next task from outside the pool goes to
+  std::atomic<std::size_t> m_next;
+
+  // the threads are started once, by the first push
+  std::once_flag m_started;
+
+  void start();
+  void push(Task task);
+  bool take(std::size_t first, Task & task);
+  void work(std::size_t index);
+
+  // run pending tasks until result is ready
+  template<typename Future>
+  void help(const Future & result);
+};
+
+template<typename F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F task, const CancelToken * cancel){
+
+  typedef typename std::result_of<F()>::type Result;
+
+  std::shared_ptr<std::packaged_task<Result()>> packaged =
+    std::make_shared<std::packaged_task<Result()>>([task, cancel]() mutable -> Result {
+	if(cancel != nullptr && cancel->cancelled()){
+	  throw SemanticError("Error: interpreter kernel interrupted");
+	}
+	return task();
+      });
+  std::future<Result> result = packaged->get_future();
+
+  if(m_workers.empty()){
+    (*packaged)();
+  }
+  else{
+    push([packaged](){ (*packaged)(); });
+  }
+  return result;
+}
+
+template<typename T>
+T ThreadPool::wait(std::future<T> & result){
+
+  help(result);
+  return result.get();
+}
+
+template<typename T>
+const T & ThreadPool::wait(const std::shared_future<T> & result){
+
+  help(result);
+  return result.get();
+}
+
+template<typename Future>
+void ThreadPool::help(const Future & result){
+
+  while(result.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+    if(!runPendingTask()){
+      // the task is running elsewhere, nothing to help with
+      result.wait_for(std::chrono::microseconds(100));
+    }
+  }
+}
+
+#endif
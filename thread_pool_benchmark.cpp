@@ -0,0 +1,62 @@
+// Measures how the thread pool scales from one worker up to the number of
+// hardware threads.
+//
+// Each run splits a fixed amount of floating-point work into nested tasks,
+// the way a parallel builtin divides a list, and reports the wall-clock time
+// and the speed-up over one worker.
+// Usage: thread_pool_benchmark [max-workers]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "thread_pool.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+const long items = 1 << 22;
+const long grain = 1 << 12;
+
+double work(long first, long last)
+{
+  double total = 0;
+  for (long i = first; i < last; ++i)
+    total += std::sin(i * 1e-3) * std::cos(i * 1e-3);
+  return total;
+}
+
+double split(ThreadPool & pool, long first, long last)
+{
+  if (last - first <= grain)
+    return work(first, last);
+
+  long middle = first + (last - first) / 2;
+  auto left = pool.submit([&pool, first, middle]() { return split(pool, first, middle); });
+  double right = split(pool, middle, last);
+  return pool.wait(left) + right;
+}
+
+int main(int argc, char *argv[])
+{
+  std::size_t max = ThreadPool::defaultWorkers();
+  if (argc == 2)
+    max = std::max(1, std::atoi(argv[1]));
+
+  double base = 0;
+  for (std::size_t workers = 1; workers <= max; ++workers) {
+    ThreadPool pool(workers);
+
+    Clock::time_point start = Clock::now();
+    auto result = pool.submit([&pool]() { return split(pool, 0, items); });
+    double total = pool.wait(result);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    if (workers == 1)
+      base = ms;
+    std::cout << workers << " workers: " << ms << " ms, speed-up " << base / ms
+              << " (checksum " << total << ")" << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cancel_token.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+// split [first, last) in halves until small, summing on the pool
+long sum(ThreadPool & pool, long first, long last){
+  if(last - first <= 16){
+    long total = 0;
+    for(long i = first; i < last; ++i) total += i;
+    return total;
+  }
+  long middle = first + (last - first) / 2;
+  auto left = pool.submit([&pool, first, middle](){ return sum(pool, first, middle); });
+  long right = sum(pool, middle, last);
+  return pool.wait(left) + right;
+}
+
+TEST_CASE( "Test thread pool runs tasks", "[thread_pool]" ) {
+
+  for(std::size_t workers : {0, 1, 4}){
+    ThreadPool pool(workers);
+    REQUIRE(pool.size() == workers);
+
+    std::vector<std::future<int>> results;
+    for(int i = 0; i < 100; ++i){
+      results.push_back(pool.submit([i](){ return i * i; }));
+    }
+    for(int i = 0; i < 100; ++i){
+      REQUIRE(pool.wait(results[i]) == i * i);
+    }
+  }
+
+  {
+    INFO("a pool nothing is submitted to starts no threads but keeps its size");
+    ThreadPool idle(4);
+    REQUIRE(idle.size() == 4);
+    REQUIRE(!idle.runPendingTask());
+  }
+}
+
+TEST_CASE( "Test thread pool nested tasks", "[thread_pool]" ) {
+
+  // with one worker every wait has to help with the pending work
+  for(std::size_t workers : {1, 3}){
+    ThreadPool pool(workers);
+    auto total = pool.submit([&pool](){ return sum(pool, 0, 10000); });
+    REQUIRE(pool.wait(total) == 49995000);
+  }
+}
+
+TEST_CASE( "Test thread pool exceptions and cancellation", "[thread_pool]" ) {
+
+  ThreadPool pool(2);
+
+  auto failed = pool.submit([]() -> int { throw SemanticError("Error: in a task"); });
+  REQUIRE_THROWS_AS(pool.wait(failed), const SemanticError &);
+
+  CancelToken token;
+  token.cancel();
+  std::atomic<bool> ran(false);
+  auto skipped = pool.submit([&ran](){ ran = true; return 1; }, &token);
+  REQUIRE_THROWS_AS(pool.wait(skipped), const SemanticError &);
+  REQUIRE(!ran);
+
+  token.reset();
+  auto runs = pool.submit([](){ return 2; }, &token);
+  REQUIRE(pool.wait(runs) == 2);
+}
+
+TEST_CASE( "Test thread pool current", "[thread_pool]" ) {
+
+  ThreadPool pool(1);
+  REQUIRE(ThreadPool::current() == nullptr);
+  {
+    ThreadPool::Scope scope(&pool);
+    REQUIRE(ThreadPool::current() == &pool);
+  }
+  REQUIRE(ThreadPool::current() == nullptr);
+
+  auto inside = pool.submit([](){ return ThreadPool::current(); });
+  REQUIRE(pool.wait(inside) == &pool);
+}